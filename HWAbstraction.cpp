@@ -25,30 +25,37 @@
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
-#include <sys/mman.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
 
-#define BCM2708_PERI_BASE        0x20000000
-#define GPIO_BASE                (BCM2708_PERI_BASE + 0x200000) /* GPIO controller */
-
-#define PAGE_SIZE (4*1024)
-#define BLOCK_SIZE (4*1024)
-// GPIO setup macros. Always use INP_GPIO(x) before using OUT_GPIO(x) or SET_GPIO_ALT(x,y)
-#define INP_GPIO(g) *(m_gpio+((g)/10)) &= ~(7<<(((g)%10)*3))
-#define OUT_GPIO(g) *(m_gpio+((g)/10)) |=  (1<<(((g)%10)*3))
-#define SET_GPIO_ALT(g,a) *(m_gpio+(((g)/10))) |= (((a)<=3?(a)+4:(a)==4?3:2)<<(((g)%10)*3))
-
-#define GPIO_SET *(m_gpio+7)  // sets   bits which are 1 ignores bits which are 0
-#define GPIO_CLR *(m_gpio+10) // clears bits which are 1 ignores bits which are 0
-
-HWAbstraction::HWAbstraction(const char* spiDevice) {
+/**
+* @brief instantiate the hardware access layer. Nothing is opened until
+* openDevice() is called.
+*
+* @param spiDevice Linux SPI device the module is wired to, like /dev/spidev0.0
+* @param speed SPI clock, in Hz
+* @param gpioChip GPIO chip device the CE pin belongs to
+* @param ceLine line offset of the CE pin inside the chip
+*/
+HWAbstraction::HWAbstraction(const char* spiDevice, uint32_t speed, const char* gpioChip, int ceLine) {
     m_spiDevice = spiDevice;
+    m_gpioChip = gpioChip;
+    m_ceLine = ceLine;
     m_fd = -1;
+    m_ceFd = -1;
+    m_irqFd = -1;
+    m_delay = 0;
+    m_speed = speed;
+    m_transfers = (struct spi_ioc_transfer*)calloc(HW_MAX_QUEUED_TRANSACTS, sizeof(struct spi_ioc_transfer));
 }
 
 HWAbstraction::~HWAbstraction() {
     if (m_fd >= 0) {
         closeDevice();
     }
+    free(m_transfers);
 }
 
 /**
@@ -61,23 +68,26 @@ HWAbstraction::~HWAbstraction() {
 int HWAbstraction::openDevice() {
     uint8_t mode = 0;
     uint8_t bits = 8;
-    uint32_t speed = 1000000;
-    int ret;
 
     m_fd = open(m_spiDevice.c_str(), O_RDWR);
     if (m_fd < 0) {
        return -1;
     }
 
-    ret = ioctl(m_fd, SPI_IOC_WR_MODE, &mode);
-    ret = ioctl(m_fd, SPI_IOC_WR_BITS_PER_WORD, &bits);
-    ret = ioctl(m_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
-    
+    if (ioctl(m_fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+            ioctl(m_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+            ioctl(m_fd, SPI_IOC_WR_MAX_SPEED_HZ, &m_speed) < 0) {
+        close(m_fd);
+        m_fd = -1;
+        return -1;
+    }
+
     if (!setupIO()) {
+        close(m_fd);
+        m_fd = -1;
         return -2;
     }
 
-    
     return 0;
 }
 
@@ -88,6 +98,45 @@ int HWAbstraction::openDevice() {
 void HWAbstraction::closeDevice() {
     close(m_fd);
     m_fd = -1;
+
+    if (m_ceFd >= 0) {
+        close(m_ceFd);
+        m_ceFd = -1;
+    }
+
+    if (m_irqFd >= 0) {
+        close(m_irqFd);
+        m_irqFd = -1;
+    }
+}
+
+/**
+* @brief Change the SPI clock. It may be called before openDevice(), to be
+* used when the device is opened.
+*
+* @param hz clock frequency, in Hz. The driver rounds it down to what the
+* controller can generate
+*
+* @return true for success, false otherwise
+*/
+bool HWAbstraction::setSpeed(uint32_t hz) {
+    if (hz == 0) {
+        return false;
+    }
+
+    if (m_fd >= 0 && ioctl(m_fd, SPI_IOC_WR_MAX_SPEED_HZ, &hz) < 0) {
+        return false;
+    }
+
+    m_speed = hz;
+    return true;
+}
+
+/**
+* @return SPI clock frequency in Hz
+*/
+uint32_t HWAbstraction::speed() const {
+    return m_speed;
 }
 
 /**
@@ -96,8 +145,7 @@ void HWAbstraction::closeDevice() {
 * @return true for success, false otherwise
 */
 bool HWAbstraction::setCE() {
-    GPIO_SET = 1 << 25;
-    return true;
+    return writeCE(true);
 }
 
 
@@ -107,72 +155,218 @@ bool HWAbstraction::setCE() {
 * @return true for success, false otherwise
 */
 bool HWAbstraction::clearCE() {
-    GPIO_CLR = 1 << 25;
-    return true;
+    return writeCE(false);
 }
 
 /**
-* @brief Send and receive bytes over SPI interface
-* The method will block until de end of transaction. tx and rx buffers must
-* be allocated prior to calling this method
+* @brief Drive the CE line through the GPIO character device
 *
-* @param tx array of size n containing data to be transmitted
-* @param rx array of size n that will be filled with bytes received
-* @param n size of tx and rx buffers
+* @param high true for logic state 1, false for 0
 *
 * @return true for success, false otherwise
 */
-bool HWAbstraction::transact(const uint8_t* tx, uint8_t* rx, int n) {
-    int ret;
+bool HWAbstraction::writeCE(bool high) {
+    struct gpio_v2_line_values values;
+
+    if (m_ceFd < 0) {
+        return false;
+    }
 
-    struct spi_ioc_transfer tr;
-    tr.tx_buf = (unsigned long)tx;
-    tr.rx_buf = (unsigned long)rx;
-    tr.len = n;
-    tr.delay_usecs = m_delay;
-    tr.speed_hz = 0;
-    tr.bits_per_word = 0;
+    values.mask = 1;
+    values.bits = high ? 1 : 0;
+    return ioctl(m_ceFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) >= 0;
+}
 
-    if (m_fd < 0) {
+/**
+* @brief Send several transactions using a single ioctl
+* Chip select is released between transactions, so the module sees them as
+* separate commands.
+*
+* @param transfers transactions to send
+* @param count how many transactions
+*
+* @return true for success, false otherwise
+*/
+bool HWAbstraction::transfer(const NRFTransfer* transfers, int count) {
+    int ret;
+
+    if (m_fd < 0 || !m_transfers) {
         //device not opened
         return false;
     }
 
-    ret = ioctl(m_fd, SPI_IOC_MESSAGE(1), &tr);
+    if (count > HW_MAX_QUEUED_TRANSACTS) {
+        return false;
+    }
+
+    struct spi_ioc_transfer* tr = m_transfers;
+    for (int i=0;i<count;i++) {
+        tr[i].tx_buf = (unsigned long)transfers[i].tx;
+        tr[i].rx_buf = (unsigned long)transfers[i].rx;
+        tr[i].len = transfers[i].size;
+        tr[i].delay_usecs = m_delay + transfers[i].delayUs;
+        //release CS between commands, except after the last one
+        tr[i].cs_change = (i < count - 1);
+    }
+
+    ret = ioctl(m_fd, SPI_IOC_MESSAGE(count), tr);
+
+    return ret >= 0;
+}
+
+/**
+* @brief Start watching the module IRQ pin through the Linux GPIO character
+* device. The pin is active low, so the line is requested as such and a falling
+* edge on the wire is reported as the line becoming active.
+*
+* @param gpioChip GPIO chip device the pin belongs to, like /dev/gpiochip0
+* @param line line offset of the IRQ pin inside the chip
+*
+* @return true for success, false otherwise
+*/
+bool HWAbstraction::openIRQ(const char* gpioChip, int line) {
+    struct gpio_v2_line_request req;
+    int chipFd;
+    int ret;
+
+    chipFd = open(gpioChip, O_RDWR | O_CLOEXEC);
+    if (chipFd < 0) {
+        return false;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    strncpy(req.consumer, "libNRF24L01p-irq", sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_ACTIVE_LOW |
+        GPIO_V2_LINE_FLAG_EDGE_RISING;
+
+    ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chipFd); //line fd stays valid on its own
+    if (ret < 0) {
+        return false;
+    }
+
+    if (m_irqFd >= 0) {
+        close(m_irqFd);
+    }
+    m_irqFd = req.fd;
+    fcntl(m_irqFd, F_SETFL, fcntl(m_irqFd, F_GETFL) | O_NONBLOCK);
 
     return true;
 }
 
-bool HWAbstraction::setupIO() {
-    int memFd;
-    /* open /dev/mem */
-    if ((memFd = open("/dev/mem", O_RDWR|O_SYNC) ) < 0) {
-        printf("can't open /dev/mem \n");
+/**
+* @brief File descriptor that becomes readable when the module raises its IRQ
+* pin. Suitable for poll(), select() or epoll.
+*
+* @return the descriptor, or -1 if openIRQ() wasn't called
+*/
+int HWAbstraction::irqFd() const {
+    return m_irqFd;
+}
+
+/**
+* @brief Check current IRQ pin level. The pin is level triggered in the module,
+* so it may be already asserted before we start waiting for an edge.
+*
+* @return true if the module is requesting attention, false otherwise
+*/
+bool HWAbstraction::irqAsserted() {
+    struct gpio_v2_line_values values;
+
+    if (m_irqFd < 0) {
         return false;
     }
 
-    /* mmap GPIO */
-    m_gpioMap = mmap(
-            NULL,             //Any adddress in our space will do
-            BLOCK_SIZE,       //Map length
-            PROT_READ|PROT_WRITE,// Enable reading & writting to mapped memory
-            MAP_SHARED,       //Shared with other processes
-            memFd,           //File to map
-            GPIO_BASE         //Offset to GPIO peripheral
-            );
+    memset(&values, 0, sizeof(values));
+    values.mask = 1;
+    if (ioctl(m_irqFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+        return false;
+    }
 
-    close(memFd); //No need to keep mem_fd open after mmap
+    return values.bits & 1;
+}
 
-    if (m_gpioMap == MAP_FAILED) {
-        printf("mmap error %p\n", m_gpioMap);//errno also set!
+/**
+* @brief Block until the module asserts its IRQ pin
+*
+* @param timeoutMs how long to wait, in milliseconds. Negative waits forever
+*
+* @return 1 if IRQ was asserted, 0 on timeout, -1 on error
+*/
+int HWAbstraction::waitIRQ(int timeoutMs) {
+    struct gpio_v2_line_event events[16];
+    struct pollfd pfd;
+    int ret;
+
+    if (m_irqFd < 0) {
+        return -1;
+    }
+
+    if (irqAsserted()) {
+        return 1;
+    }
+
+    pfd.fd = m_irqFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do {
+        ret = poll(&pfd, 1, timeoutMs);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret <= 0) {
+        return ret;
+    }
+
+    //drain queued edge events, we only care that something happened
+    while (read(m_irqFd, events, sizeof(events)) > 0) {
+    }
+
+    return 1;
+}
+
+/**
+* @brief Request the CE line as an output, starting low
+* Goes through the GPIO character device, so it works on every board with a
+* kernel driver for its GPIO controller and needs no access to /dev/mem.
+*
+* @return true for success, false otherwise
+*/
+bool HWAbstraction::setupIO() {
+    struct gpio_v2_line_request req;
+    int chipFd;
+    int ret;
+
+    chipFd = open(m_gpioChip.c_str(), O_RDWR | O_CLOEXEC);
+    if (chipFd < 0) {
+        printf("can't open %s\n", m_gpioChip.c_str());
         return false;
     }
 
-    // Always use volatile pointer!
-    m_gpio = (volatile unsigned *)m_gpioMap;
-    INP_GPIO(25);
-    OUT_GPIO(25);
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = m_ceLine;
+    req.num_lines = 1;
+    strncpy(req.consumer, "libNRF24L01p-ce", sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    //start low, so the module doesn't leave standby before being configured
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values = 0;
+    req.config.attrs[0].mask = 1;
 
-    return true;
-} // setup_io
+    ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chipFd); //line fd stays valid on its own
+    if (ret < 0) {
+        printf("can't request CE line %d\n", m_ceLine);
+        return false;
+    }
 
+    if (m_ceFd >= 0) {
+        close(m_ceFd);
+    }
+    m_ceFd = req.fd;
+
+    return true;
+}
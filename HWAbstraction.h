@@ -19,27 +19,49 @@
 #ifndef HW_ABSTRACTION_H
 #define HW_ABSTRACTION_H
 
+#include "NRFTransport.h"
 #include <string>
 #include <stdint.h>
 
-class HWAbstraction {
+//CE on the pin used by most Raspberry Pi adapters
+#define HW_GPIO_CHIP "/dev/gpiochip0"
+#define HW_CE_LINE 25
+
+struct spi_ioc_transfer;
+
+class HWAbstraction : public NRFTransport {
     public:
-    HWAbstraction(const char* spiDevice);
+    HWAbstraction(const char* spiDevice, uint32_t speed = NRF_SPI_DEFAULT_SPEED,
+            const char* gpioChip = HW_GPIO_CHIP, int ceLine = HW_CE_LINE);
     ~HWAbstraction();
 
     int openDevice();
     void closeDevice();
     bool setCE();
     bool clearCE();
-    bool transact(const uint8_t* tx, uint8_t* rx, int n);
+    bool openIRQ(const char* gpioChip, int line);
+    bool setSpeed(uint32_t hz);
+    uint32_t speed() const;
+    int irqFd() const;
+    bool irqAsserted();
+    int waitIRQ(int timeoutMs);
+
+    protected:
+    bool transfer(const NRFTransfer* transfers, int count);
 
     private:
     bool setupIO();
+    bool writeCE(bool high);
     int m_fd;
+    int m_ceFd;
+    int m_irqFd;
     uint16_t m_delay;
+    uint32_t m_speed;
     std::string m_spiDevice;
-    void *m_gpioMap;
-    volatile unsigned int *m_gpio;
+    std::string m_gpioChip;
+    int m_ceLine;
+    //only buffers, lengths and CS handling change between submissions
+    struct spi_ioc_transfer* m_transfers;
 };
 
 #endif
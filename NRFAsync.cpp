@@ -0,0 +1,525 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFAsync.h"
+
+#if __cplusplus >= 202002L
+
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#define NRF_ASYNC_MAX_EVENTS 16
+
+static uint64_t monotonicUs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+* @brief instantiate an event loop without radios
+*/
+NRFEventLoop::NRFEventLoop() {
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_running = false;
+}
+
+/**
+* @brief releases resources used by the loop. Coroutines still waiting are
+* never resumed.
+*/
+NRFEventLoop::~NRFEventLoop() {
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+    }
+}
+
+/**
+* @brief File descriptor that becomes readable when a radio needs attention.
+* Timeouts don't make it readable; an outer loop should also wake up from
+* time to time, or use run() instead.
+*
+* @return the descriptor
+*/
+int NRFEventLoop::fd() const {
+    return m_epollFd;
+}
+
+/**
+* @brief Wait for radio events or timeouts, then resume every coroutine whose
+* operation completed
+*
+* @param timeoutMs how long to wait for something to happen, in
+* milliseconds. -1 waits forever
+*
+* @return number of coroutines resumed, or -1 on error
+*/
+int NRFEventLoop::runOnce(int timeoutMs) {
+    struct epoll_event events[NRF_ASYNC_MAX_EVENTS];
+    std::vector<NRFAsyncWaiter*> ready;
+    uint64_t now;
+    int count;
+
+    count = epoll_wait(m_epollFd, events, NRF_ASYNC_MAX_EVENTS, nextTimeout(m_ready.empty() ? timeoutMs : 0));
+    if (count < 0) {
+        return -1;
+    }
+
+    for (int i=0;i<count;i++) {
+        ((NRFAsyncRadio*)events[i].data.ptr)->service();
+    }
+    for (size_t i=0;i<m_polledRadios.size();i++) {
+        m_polledRadios[i]->service();
+    }
+
+    now = monotonicUs();
+    while (!m_timers.empty() && m_timers.begin()->first <= now) {
+        NRFAsyncWaiter* waiter = m_timers.begin()->second;
+
+        m_timers.erase(m_timers.begin());
+        waiter->timed = false;
+        if (waiter->radio) {
+            waiter->radio->expire(waiter);
+        }
+        else {
+            complete(waiter, true);
+        }
+    }
+
+    //resumed coroutines may start new operations, which land in m_ready
+    ready.swap(m_ready);
+    for (size_t i=0;i<ready.size();i++) {
+        ready[i]->handle.resume();
+    }
+
+    return ready.size();
+}
+
+/**
+* @brief Run until stop() is called, usually from one of the coroutines
+*/
+void NRFEventLoop::run() {
+    m_running = true;
+    while (m_running) {
+        if (runOnce() < 0) {
+            break;
+        }
+    }
+}
+
+/**
+* @brief Make run() return once the current iteration is over
+*/
+void NRFEventLoop::stop() {
+    m_running = false;
+}
+
+/**
+* @brief Suspend the calling coroutine for a while
+*
+* @param timeoutMs how long to sleep, in milliseconds
+*
+* @return awaitable to co_await on
+*/
+NRFEventLoop::SleepAwaiter NRFEventLoop::sleep(int timeoutMs) {
+    return SleepAwaiter(this, timeoutMs);
+}
+
+bool NRFEventLoop::addRadio(NRFAsyncRadio* radio) {
+    struct epoll_event event;
+    int fd = radio->controller()->eventFd();
+
+    if (fd < 0) {
+        m_polledRadios.push_back(radio);
+        return true;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = radio;
+    return epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void NRFEventLoop::removeRadio(NRFAsyncRadio* radio) {
+    int fd = radio->controller()->eventFd();
+
+    if (fd >= 0) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    for (size_t i=0;i<m_polledRadios.size();i++) {
+        if (m_polledRadios[i] == radio) {
+            m_polledRadios.erase(m_polledRadios.begin() + i);
+            break;
+        }
+    }
+}
+
+void NRFEventLoop::addTimer(NRFAsyncWaiter* waiter, int timeoutMs) {
+    waiter->timed = timeoutMs >= 0;
+    if (waiter->timed) {
+        waiter->timer = m_timers.emplace(monotonicUs() + (uint64_t)timeoutMs * 1000, waiter);
+    }
+}
+
+void NRFEventLoop::cancelTimer(NRFAsyncWaiter* waiter) {
+    if (waiter->timed) {
+        m_timers.erase(waiter->timer);
+        waiter->timed = false;
+    }
+}
+
+/**
+* @brief Finish an operation. The coroutine is resumed at the end of the
+* current iteration, never from inside the radio code.
+*/
+void NRFEventLoop::complete(NRFAsyncWaiter* waiter, bool ok) {
+    cancelTimer(waiter);
+    waiter->ok = ok;
+    waiter->pending = false;
+    m_ready.push_back(waiter);
+}
+
+/**
+* @brief How long epoll may sleep without missing a timer or a polled radio
+*/
+int NRFEventLoop::nextTimeout(int timeoutMs) {
+    if (!m_timers.empty()) {
+        uint64_t now = monotonicUs();
+        uint64_t first = m_timers.begin()->first;
+        //round up, waking early would just spin
+        int timerMs = first > now ? (first - now + 999) / 1000 : 0;
+
+        if (timeoutMs < 0 || timerMs < timeoutMs) {
+            timeoutMs = timerMs;
+        }
+    }
+
+    if (!m_polledRadios.empty() && (timeoutMs < 0 || timeoutMs > NRF_ASYNC_POLL_MS)) {
+        timeoutMs = NRF_ASYNC_POLL_MS;
+    }
+
+    return timeoutMs;
+}
+
+NRFEventLoop::SleepAwaiter::SleepAwaiter(NRFEventLoop* loop, int timeoutMs) {
+    m_loop = loop;
+    m_timeoutMs = timeoutMs;
+    m_waiter.radio = NULL;
+    m_waiter.pending = false;
+    m_waiter.timed = false;
+    m_waiter.list = NULL;
+}
+
+NRFEventLoop::SleepAwaiter::~SleepAwaiter() {
+    if (m_waiter.pending) {
+        m_loop->cancelTimer(&m_waiter);
+    }
+}
+
+void NRFEventLoop::SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_waiter.handle = handle;
+    m_waiter.pending = true;
+    m_loop->addTimer(&m_waiter, m_timeoutMs);
+}
+
+/**
+* @brief instantiate an asynchronous radio. Nothing happens until start().
+*
+* @param loop loop driving the radio
+* @param controller controller to drive. It's not owned by the radio
+*/
+NRFAsyncRadio::NRFAsyncRadio(NRFEventLoop* loop, NRFController* controller) {
+    m_loop = loop;
+    m_controller = controller;
+    m_sending = NULL;
+    m_txMode = false;
+    m_droppedPackets = 0;
+}
+
+/**
+* @brief detaches the radio from its loop. Coroutines still waiting on it are
+* never resumed.
+*/
+NRFAsyncRadio::~NRFAsyncRadio() {
+    m_loop->removeRadio(this);
+}
+
+/**
+* @brief Put the radio in RX mode and attach it to the loop
+*
+* @return true for success, false otherwise
+*/
+bool NRFAsyncRadio::start() {
+    if (!m_controller->setMode(NRFController::NRFRxMode)) {
+        return false;
+    }
+
+    m_txMode = false;
+    return m_loop->addRadio(this);
+}
+
+/**
+* @brief Wait for a package. Packages arriving while nobody waits are kept,
+* up to NRF_ASYNC_RX_BUFFER.
+*
+* @param timeoutMs how long to wait, in milliseconds. -1 waits forever
+*
+* @return awaitable resulting in the package, or nothing on timeout
+*/
+NRFAsyncRadio::ReceiveAwaiter NRFAsyncRadio::receive(int timeoutMs) {
+    return ReceiveAwaiter(this, timeoutMs);
+}
+
+/**
+* @brief Send a package, completing when it's acknowledged or the module gives
+* up. Packages are sent one at a time, in the order send() was called.
+*
+* @param packet package to send. Pipe is ignored, size is used as in sendPkg()
+* @param timeoutMs how long to wait, counting the time spent behind other
+* packages, in milliseconds. -1 waits forever
+*
+* @return awaitable resulting in true if the package was acknowledged
+*/
+NRFAsyncRadio::SendAwaiter NRFAsyncRadio::send(const NRFPacket& packet, int timeoutMs) {
+    return SendAwaiter(this, packet, timeoutMs);
+}
+
+/**
+* @brief Get the controller driven by the radio
+*
+* @return the controller
+*/
+NRFController* NRFAsyncRadio::controller() {
+    return m_controller;
+}
+
+/**
+* @brief How many received packages were discarded because nobody was waiting
+* and the buffer was full
+*
+* @return number of packages
+*/
+uint64_t NRFAsyncRadio::droppedPackets() const {
+    return m_droppedPackets;
+}
+
+/**
+* @brief Handle whatever the module signaled
+*/
+void NRFAsyncRadio::service() {
+    NRFPacket packets[NRF_RX_FIFO_DEPTH];
+    int events = NRF_STATUS_IRQ_MASK;
+    int count;
+
+    //reading the IRQ also rearms the descriptor
+    if (m_controller->eventFd() >= 0) {
+        events = m_controller->waitForEvent(0);
+        if (events <= 0) {
+            return;
+        }
+    }
+    else if (!m_controller->refreshStatus()) {
+        return;
+    }
+
+    if (m_sending) {
+        int result = m_controller->completeSend();
+        if (result != 0) {
+            finishSend(result > 0);
+        }
+    }
+    else if (events & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)) {
+        //leftover from a cancelled send, it would keep the IRQ pin asserted
+        m_controller->clearEvents(NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT);
+    }
+
+    //ACK payloads show up in TX mode too
+    if (events & NRF_STATUS_RX_DR) {
+        while ((count = m_controller->readBurst(packets, NRF_RX_FIFO_DEPTH)) > 0) {
+            for (int i=0;i<count;i++) {
+                deliver(packets[i]);
+            }
+        }
+    }
+}
+
+void NRFAsyncRadio::deliver(const NRFPacket& packet) {
+    if (!m_receivers.empty()) {
+        NRFAsyncWaiter* waiter = m_receivers.front();
+
+        m_receivers.pop_front();
+        waiter->list = NULL;
+        waiter->packet = packet;
+        m_loop->complete(waiter, true);
+    }
+    else if (m_rxBuffer.size() < NRF_ASYNC_RX_BUFFER) {
+        m_rxBuffer.push_back(packet);
+    }
+    else {
+        m_droppedPackets++;
+    }
+}
+
+void NRFAsyncRadio::setTxMode(bool tx) {
+    if (tx != m_txMode) {
+        m_controller->setMode(tx ? NRFController::NRFTxMode : NRFController::NRFRxMode);
+        m_txMode = tx;
+    }
+}
+
+/**
+* @brief Start the oldest queued send, if the radio is free. Back to RX mode
+* when there's nothing left to send.
+*/
+void NRFAsyncRadio::startNextSend() {
+    while (!m_sending && !m_senders.empty()) {
+        NRFAsyncWaiter* waiter = m_senders.front();
+
+        m_senders.pop_front();
+        waiter->list = NULL;
+        setTxMode(true);
+        if (m_controller->startSend((const char*)waiter->packet.data, waiter->packet.size ? waiter->packet.size : -1)) {
+            m_sending = waiter;
+        }
+        else {
+            m_loop->complete(waiter, false);
+        }
+    }
+
+    if (!m_sending) {
+        setTxMode(false);
+    }
+}
+
+void NRFAsyncRadio::finishSend(bool ok) {
+    NRFAsyncWaiter* waiter = m_sending;
+
+    m_sending = NULL;
+    m_loop->complete(waiter, ok);
+    startNextSend();
+}
+
+/**
+* @brief Forget an operation whose coroutine went away
+*/
+void NRFAsyncRadio::cancel(NRFAsyncWaiter* waiter) {
+    m_loop->cancelTimer(waiter);
+    waiter->pending = false;
+
+    if (waiter == m_sending) {
+        m_controller->cancelSend();
+        m_sending = NULL;
+        startNextSend();
+    }
+    else if (waiter->list) {
+        waiter->list->erase(waiter->queued);
+        waiter->list = NULL;
+    }
+}
+
+/**
+* @brief Fail an operation whose timeout expired
+*/
+void NRFAsyncRadio::expire(NRFAsyncWaiter* waiter) {
+    if (waiter == m_sending) {
+        m_controller->cancelSend();
+        finishSend(false);
+        return;
+    }
+
+    if (waiter->list) {
+        waiter->list->erase(waiter->queued);
+        waiter->list = NULL;
+    }
+    m_loop->complete(waiter, false);
+}
+
+NRFAsyncRadio::ReceiveAwaiter::ReceiveAwaiter(NRFAsyncRadio* radio, int timeoutMs) {
+    m_radio = radio;
+    m_timeoutMs = timeoutMs;
+    m_waiter.radio = radio;
+    m_waiter.ok = false;
+    m_waiter.pending = false;
+    m_waiter.timed = false;
+    m_waiter.list = NULL;
+}
+
+NRFAsyncRadio::ReceiveAwaiter::~ReceiveAwaiter() {
+    if (m_waiter.pending) {
+        m_radio->cancel(&m_waiter);
+    }
+}
+
+bool NRFAsyncRadio::ReceiveAwaiter::await_ready() {
+    if (m_radio->m_rxBuffer.empty()) {
+        return false;
+    }
+
+    m_waiter.packet = m_radio->m_rxBuffer.front();
+    m_waiter.ok = true;
+    m_radio->m_rxBuffer.pop_front();
+    return true;
+}
+
+void NRFAsyncRadio::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_waiter.handle = handle;
+    m_waiter.pending = true;
+    m_waiter.list = &m_radio->m_receivers;
+    m_waiter.queued = m_radio->m_receivers.insert(m_radio->m_receivers.end(), &m_waiter);
+    m_radio->m_loop->addTimer(&m_waiter, m_timeoutMs);
+}
+
+std::optional<NRFPacket> NRFAsyncRadio::ReceiveAwaiter::await_resume() {
+    if (!m_waiter.ok) {
+        return std::nullopt;
+    }
+    return m_waiter.packet;
+}
+
+NRFAsyncRadio::SendAwaiter::SendAwaiter(NRFAsyncRadio* radio, const NRFPacket& packet, int timeoutMs) {
+    m_radio = radio;
+    m_timeoutMs = timeoutMs;
+    m_waiter.radio = radio;
+    m_waiter.packet = packet;
+    m_waiter.ok = false;
+    m_waiter.pending = false;
+    m_waiter.timed = false;
+    m_waiter.list = NULL;
+}
+
+NRFAsyncRadio::SendAwaiter::~SendAwaiter() {
+    if (m_waiter.pending) {
+        m_radio->cancel(&m_waiter);
+    }
+}
+
+void NRFAsyncRadio::SendAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_waiter.handle = handle;
+    m_waiter.pending = true;
+    m_waiter.list = &m_radio->m_senders;
+    m_waiter.queued = m_radio->m_senders.insert(m_radio->m_senders.end(), &m_waiter);
+    m_radio->m_loop->addTimer(&m_waiter, m_timeoutMs);
+    m_radio->startNextSend();
+}
+
+bool NRFAsyncRadio::SendAwaiter::await_resume() const {
+    return m_waiter.ok;
+}
+
+#endif
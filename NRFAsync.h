@@ -0,0 +1,191 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_ASYNC_H
+#define NRF_ASYNC_H
+
+//the rest of the library is C++11, only this part needs C++20 coroutines
+#if __cplusplus >= 202002L
+
+#include "NRFController.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <list>
+#include <map>
+#include <optional>
+#include <vector>
+
+#define NRF_ASYNC_RX_BUFFER 64
+#define NRF_ASYNC_POLL_MS 1
+#define NRF_ASYNC_SEND_TIMEOUT_MS NRF_TX_TIMEOUT_MS
+
+class NRFEventLoop;
+class NRFAsyncRadio;
+
+/**
+* @brief Fire and forget coroutine. It starts right away and frees itself when
+* it returns.
+*/
+struct NRFTask {
+    struct promise_type {
+        NRFTask get_return_object() { return NRFTask(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/**
+* @brief A suspended operation: who to resume and with what
+*/
+struct NRFAsyncWaiter {
+    std::coroutine_handle<> handle;
+    NRFAsyncRadio* radio;
+    NRFPacket packet;
+    bool ok;
+    bool pending;
+    bool timed;
+    std::list<NRFAsyncWaiter*>* list;
+    std::list<NRFAsyncWaiter*>::iterator queued;
+    std::multimap<uint64_t, NRFAsyncWaiter*>::iterator timer;
+};
+
+/**
+* @brief Single threaded reactor resuming coroutines when radios raise their
+* IRQ pin or timeouts expire. Run it with run(), or watch fd() from another
+* event loop and call runOnce(0) when it's readable.
+*/
+class NRFEventLoop {
+    public:
+    class SleepAwaiter {
+        public:
+        SleepAwaiter(NRFEventLoop* loop, int timeoutMs);
+        SleepAwaiter(const SleepAwaiter&) = delete;
+        ~SleepAwaiter();
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const {}
+
+        private:
+        NRFEventLoop* m_loop;
+        int m_timeoutMs;
+        NRFAsyncWaiter m_waiter;
+    };
+
+    NRFEventLoop();
+    ~NRFEventLoop();
+
+    int fd() const;
+    int runOnce(int timeoutMs = -1);
+    void run();
+    void stop();
+    SleepAwaiter sleep(int timeoutMs);
+
+    private:
+    friend class NRFAsyncRadio;
+
+    bool addRadio(NRFAsyncRadio* radio);
+    void removeRadio(NRFAsyncRadio* radio);
+    void addTimer(NRFAsyncWaiter* waiter, int timeoutMs);
+    void cancelTimer(NRFAsyncWaiter* waiter);
+    void complete(NRFAsyncWaiter* waiter, bool ok);
+    int nextTimeout(int timeoutMs);
+
+    int m_epollFd;
+    bool m_running;
+    std::multimap<uint64_t, NRFAsyncWaiter*> m_timers;
+    std::vector<NRFAsyncWaiter*> m_ready;
+    std::vector<NRFAsyncRadio*> m_polledRadios;
+};
+
+/**
+* @brief Awaitable send and receive on a controller, driven by a NRFEventLoop.
+* Any number of coroutines may wait on the same radio: received packages go to
+* receivers in the order they started waiting, sends go out one at a time in
+* the order they were issued. The radio stays in RX mode, except while sending.
+* The controller must be configured and powered up, with its IRQ pin set up
+* through setIRQ() (otherwise it's polled every NRF_ASYNC_POLL_MS), and must
+* not be used by anyone else meanwhile.
+*/
+class NRFAsyncRadio {
+    public:
+    class ReceiveAwaiter {
+        public:
+        ReceiveAwaiter(NRFAsyncRadio* radio, int timeoutMs);
+        ReceiveAwaiter(const ReceiveAwaiter&) = delete;
+        ~ReceiveAwaiter();
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        std::optional<NRFPacket> await_resume();
+
+        private:
+        NRFAsyncRadio* m_radio;
+        int m_timeoutMs;
+        NRFAsyncWaiter m_waiter;
+    };
+
+    class SendAwaiter {
+        public:
+        SendAwaiter(NRFAsyncRadio* radio, const NRFPacket& packet, int timeoutMs);
+        SendAwaiter(const SendAwaiter&) = delete;
+        ~SendAwaiter();
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const;
+
+        private:
+        NRFAsyncRadio* m_radio;
+        int m_timeoutMs;
+        NRFAsyncWaiter m_waiter;
+    };
+
+    NRFAsyncRadio(NRFEventLoop* loop, NRFController* controller);
+    ~NRFAsyncRadio();
+
+    bool start();
+    ReceiveAwaiter receive(int timeoutMs = -1);
+    SendAwaiter send(const NRFPacket& packet, int timeoutMs = NRF_ASYNC_SEND_TIMEOUT_MS);
+    NRFController* controller();
+    uint64_t droppedPackets() const;
+
+    private:
+    friend class NRFEventLoop;
+
+    void service();
+    void setTxMode(bool tx);
+    void startNextSend();
+    void finishSend(bool ok);
+    void deliver(const NRFPacket& packet);
+    void cancel(NRFAsyncWaiter* waiter);
+    void expire(NRFAsyncWaiter* waiter);
+
+    NRFEventLoop* m_loop;
+    NRFController* m_controller;
+    std::deque<NRFPacket> m_rxBuffer;
+    std::list<NRFAsyncWaiter*> m_receivers;
+    std::list<NRFAsyncWaiter*> m_senders;
+    NRFAsyncWaiter* m_sending;
+    bool m_txMode;
+    uint64_t m_droppedPackets;
+};
+
+#endif
+
+#endif
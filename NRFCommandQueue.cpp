@@ -0,0 +1,298 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFCommandQueue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/**
+* @brief instantiate a queue for a controller. The controller must be already
+* configured, and it's not owned by the queue.
+*
+* @param controller controller to drive
+*/
+NRFCommandQueue::NRFCommandQueue(NRFController* controller) {
+    m_controller = controller;
+    m_head = NULL;
+    m_running = false;
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+/**
+* @brief stops the executor thread, runs whatever is still queued and releases
+* resources used by the queue
+*/
+NRFCommandQueue::~NRFCommandQueue() {
+    stop();
+    process();
+    if (m_eventFd >= 0) {
+        close(m_eventFd);
+    }
+}
+
+/**
+* @brief Start the executor thread. While it runs, process() must not be
+* called and the controller must not be used by anyone else.
+*
+* @param cpu CPU to pin the executor to, or -1 to let the scheduler choose
+*
+* @return true for success, false otherwise
+*/
+bool NRFCommandQueue::start(int cpu) {
+    if (m_running || m_eventFd < 0) {
+        return false;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&NRFCommandQueue::run, this);
+
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        //not fatal, the thread just stays unpinned
+        pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus);
+    }
+    return true;
+}
+
+/**
+* @brief Stop the executor thread, once it ran everything queued so far
+*/
+void NRFCommandQueue::stop() {
+    if (!m_running) {
+        return;
+    }
+
+    m_running = false;
+    signal();
+    m_thread.join();
+}
+
+/**
+* @brief Tell if the executor thread is running
+*
+* @return true if running, false otherwise
+*/
+bool NRFCommandQueue::running() const {
+    return m_running;
+}
+
+/**
+* @brief Run every command queued so far, in the order they were posted, and
+* complete their futures. Only the executor may call this.
+*
+* @return number of commands run
+*/
+int NRFCommandQueue::process() {
+    Command* command = takeAll();
+    int count = 0;
+
+    while (command) {
+        if (command->type == CommandSend) {
+            command = runSends(command, count);
+        }
+        else if (command->type == CommandChannel) {
+            command = runChannels(command, count);
+        }
+        else {
+            Command* next = command->next;
+            command->function(*m_controller);
+            delete command;
+            command = next;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+* @brief Queue a package for transmission. Module must be in TX mode when the
+* executor gets to it.
+*
+* @param packet package to send. Pipe is ignored, size is only used with
+* dynamic payload length
+*
+* @return future telling if the package was acknowledged
+*/
+std::future<bool> NRFCommandQueue::send(const NRFPacket& packet) {
+    Command* command = new Command();
+    std::future<bool> future = command->result.get_future();
+
+    command->type = CommandSend;
+    command->packet = packet;
+    post(command);
+    return future;
+}
+
+/**
+* @brief Queue a channel change
+*
+* @param channel new channel
+*
+* @return future telling if the channel was set
+*/
+std::future<bool> NRFCommandQueue::setChannel(int channel) {
+    Command* command = new Command();
+    std::future<bool> future = command->result.get_future();
+
+    command->type = CommandChannel;
+    command->channel = channel;
+    post(command);
+    return future;
+}
+
+void NRFCommandQueue::post(Command* command) {
+    Command* head = m_head.load(std::memory_order_relaxed);
+
+    do {
+        command->next = head;
+    } while (!m_head.compare_exchange_weak(head, command,
+                std::memory_order_release, std::memory_order_relaxed));
+
+    //the executor only needs a wakeup when the queue goes from empty to not
+    if (head == NULL) {
+        signal();
+    }
+}
+
+/**
+* @brief Detach every posted command
+*
+* @return the commands in posting order
+*/
+NRFCommandQueue::Command* NRFCommandQueue::takeAll() {
+    Command* command = m_head.exchange(NULL, std::memory_order_acquire);
+    Command* ordered = NULL;
+
+    //producers push to the front, so the list is newest first
+    while (command) {
+        Command* next = command->next;
+        command->next = ordered;
+        ordered = command;
+        command = next;
+    }
+
+    return ordered;
+}
+
+/**
+* @brief Send a run of consecutive packages in as few pipelined batches as possible
+*
+* @param command first send of the run
+* @param count incremented for every command run
+*
+* @return first command after the run
+*/
+NRFCommandQueue::Command* NRFCommandQueue::runSends(Command* command, int& count) {
+    while (command && command->type == CommandSend) {
+        Command* first = command;
+        int batched = 0;
+        int sent;
+
+        while (command && command->type == CommandSend && batched < NRF_COMMAND_BATCH) {
+            m_batch[batched++] = command->packet;
+            command = command->next;
+        }
+
+        sent = m_controller->writePackets(m_batch, batched);
+        count += batched;
+        for (int i=0;i<batched;i++) {
+            Command* next = first->next;
+            first->result.set_value(i < sent);
+            delete first;
+            first = next;
+        }
+    }
+
+    return command;
+}
+
+/**
+* @brief Apply only the last valid one of a run of consecutive channel
+* changes, the others would be overwritten right away. Invalid channels fail
+* on their own, the valid ones share the result of the change that
+* superseded them.
+*
+* @param command first channel change of the run
+* @param count incremented for every command run
+*
+* @return first command after the run
+*/
+NRFCommandQueue::Command* NRFCommandQueue::runChannels(Command* command, int& count) {
+    Command* last = NULL;
+    Command* end = command;
+    bool ok = false;
+
+    while (end && end->type == CommandChannel) {
+        if (end->channel >= 0 && end->channel <= NRF_MAX_CHANNEL) {
+            last = end;
+        }
+        end = end->next;
+    }
+
+    if (last) {
+        ok = m_controller->setChannel(last->channel);
+    }
+    while (command != end) {
+        Command* next = command->next;
+        bool valid = command->channel >= 0 && command->channel <= NRF_MAX_CHANNEL;
+
+        command->result.set_value(valid && ok);
+        delete command;
+        command = next;
+        count++;
+    }
+
+    return command;
+}
+
+void NRFCommandQueue::run() {
+    struct pollfd fds;
+
+    fds.fd = m_eventFd;
+    fds.events = POLLIN;
+
+    while (m_running) {
+        drain();
+        process();
+        if (m_head.load(std::memory_order_relaxed) == NULL) {
+            fds.revents = 0;
+            poll(&fds, 1, -1);
+        }
+    }
+
+    //whatever was posted before stop() still runs
+    process();
+}
+
+void NRFCommandQueue::signal() {
+    uint64_t one = 1;
+    ssize_t ret = write(m_eventFd, &one, sizeof(one));
+    (void)ret;
+}
+
+void NRFCommandQueue::drain() {
+    uint64_t value;
+    ssize_t ret = read(m_eventFd, &value, sizeof(value));
+    (void)ret;
+}
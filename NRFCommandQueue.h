@@ -0,0 +1,109 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_COMMAND_QUEUE_H
+#define NRF_COMMAND_QUEUE_H
+
+#include "NRFController.h"
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+
+#define NRF_COMMAND_BATCH 64
+
+/**
+* @brief Lets any number of threads share a controller. Threads post commands
+* to a lock free queue and get a future for the result; a single executor
+* drains the queue and is the only one touching the controller. Commands that
+* piled up meanwhile are merged: consecutive sends go out in one pipelined run
+* (see NRFController::writePackets()) and consecutive channel changes only
+* write the last channel. The executor is either the queue's own thread (see
+* start()) or whoever calls process().
+*/
+class NRFCommandQueue {
+    public:
+    NRFCommandQueue(NRFController* controller);
+    ~NRFCommandQueue();
+
+    bool start(int cpu = -1);
+    void stop();
+    bool running() const;
+    int process();
+
+    std::future<bool> send(const NRFPacket& packet);
+    std::future<bool> setChannel(int channel);
+    template<class Function>
+    std::future<typename std::result_of<Function(NRFController&)>::type> call(Function function);
+
+    private:
+    enum CommandType {
+        CommandSend,
+        CommandChannel,
+        CommandCall
+    };
+
+    struct Command {
+        Command* next;
+        CommandType type;
+        NRFPacket packet;
+        int channel;
+        std::promise<bool> result;
+        std::function<void(NRFController&)> function;
+    };
+
+    void post(Command* command);
+    Command* takeAll();
+    Command* runSends(Command* command, int& count);
+    Command* runChannels(Command* command, int& count);
+    void run();
+    void signal();
+    void drain();
+
+    NRFController* m_controller;
+    std::atomic<Command*> m_head;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    int m_eventFd;
+    NRFPacket m_batch[NRF_COMMAND_BATCH];
+};
+
+/**
+* @brief Run any function on the controller, from the executor
+*
+* @param function called with the controller. Its return value completes the future
+*
+* @return future for the value returned by function
+*/
+template<class Function>
+std::future<typename std::result_of<Function(NRFController&)>::type> NRFCommandQueue::call(Function function) {
+    typedef typename std::result_of<Function(NRFController&)>::type Result;
+    //std::function must be copyable, packaged_task isn't
+    std::shared_ptr<std::packaged_task<Result(NRFController&)> > task =
+        std::make_shared<std::packaged_task<Result(NRFController&)> >(function);
+    std::future<Result> future = task->get_future();
+    Command* command = new Command();
+
+    command->type = CommandCall;
+    command->function = [task](NRFController& controller) { (*task)(controller); };
+    post(command);
+    return future;
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFConfig.h"
+#include <string.h>
+
+/**
+* @brief Build a config holding the nRF24L01+ reset values
+*/
+NRFConfig::NRFConfig() {
+    channel = 2;
+    dataRate = NRFController::NRF2Mbps;
+    powerLevel = NRFController::NRFPower0dBm;
+    crcBytes = 1;
+    addressWidth = 5;
+    retries = 3;
+    retransmitDelayUs = 250;
+    ackPayload = false;
+    dynamicAck = false;
+    irqMask = 0;
+    powerUp = false;
+    mode = NRFController::NRFTxMode;
+    txAddress = 0xE7E7E7E7E7ULL;
+
+    for (int i=0;i<NRF_PIPE_COUNT;i++) {
+        pipes[i].enabled = i < 2;
+        pipes[i].autoAck = true;
+        pipes[i].dynamicPayload = false;
+        pipes[i].payloadSize = 0;
+        pipes[i].address = 0xC2C2C2C2C2ULL + i - 1;
+    }
+    pipes[0].address = 0xE7E7E7E7E7ULL;
+}
+
+/**
+* @brief Translate the config to the values of every stable register
+*
+* @param image receives register values, indexed by NRF_REG_* defines. Address
+* registers of pipes 0 and 1 and TX_ADDR use NRF_MAX_ADDRESS_SIZE bytes, every
+* other register a single byte
+*
+* @return true for success, false if some setting is out of range
+*/
+bool NRFConfig::encode(uint8_t image[NRF_REG_COUNT][NRF_MAX_ADDRESS_SIZE]) const {
+    uint8_t enAA = 0;
+    uint8_t enRxAddr = 0;
+    uint8_t dynpd = 0;
+    uint64_t address;
+
+    //validate input
+    if (channel < 0 || channel > NRF_MAX_CHANNEL || crcBytes < 0 || crcBytes > 2 ||
+            addressWidth < 3 || addressWidth > 5 || retries < 0 || retries > 15 ||
+            retransmitDelayUs < 250 || retransmitDelayUs > 4000 || retransmitDelayUs % 250 ||
+            (dataRate != NRFController::NRF1Mbps && dataRate != NRFController::NRF2Mbps &&
+             dataRate != NRFController::NRF250kbps) ||
+            powerLevel < NRFController::NRFPowerMinus18dBm || powerLevel > NRFController::NRFPower0dBm) {
+        return false;
+    }
+
+    memset(image, 0, NRF_REG_COUNT * NRF_MAX_ADDRESS_SIZE);
+
+    for (int i=0;i<NRF_PIPE_COUNT;i++) {
+        if (pipes[i].payloadSize > NRF_MAX_PAYLOAD_SIZE) {
+            return false;
+        }
+        enAA |= pipes[i].autoAck << i;
+        enRxAddr |= pipes[i].enabled << i;
+        dynpd |= pipes[i].dynamicPayload << i;
+        image[NRF_REG_RX_PW_P0 + i][0] = pipes[i].payloadSize;
+
+        address = pipes[i].address;
+        for (int j=0;j<(i < 2 ? NRF_MAX_ADDRESS_SIZE : 1);j++) {
+            image[NRF_REG_RX_ADDR_P0 + i][j] = address & 0xFF;
+            address >>= 8;
+        }
+    }
+
+    address = txAddress;
+    for (int j=0;j<NRF_MAX_ADDRESS_SIZE;j++) {
+        image[NRF_REG_TX_ADDR][j] = address & 0xFF;
+        address >>= 8;
+    }
+
+    image[NRF_REG_CONFIG][0] = (irqMask & NRF_STATUS_IRQ_MASK) |
+        nrfField<NRFReg::EN_CRC>(crcBytes > 0).bits |
+        nrfField<NRFReg::CRCO>(crcBytes == 2).bits |
+        nrfField<NRFReg::PWR_UP>(powerUp).bits |
+        nrfField<NRFReg::PRIM_RX>(mode == NRFController::NRFRxMode).bits;
+    image[NRF_REG_EN_AA][0] = enAA;
+    image[NRF_REG_EN_RXADDR][0] = enRxAddr;
+    image[NRF_REG_SETUP_AW][0] = nrfField<NRFReg::AW>(addressWidth - 2).bits;
+    image[NRF_REG_SETUP_RETR][0] = nrfField<NRFReg::ARD>(retransmitDelayUs / 250 - 1).bits |
+        nrfField<NRFReg::ARC>(retries).bits;
+    image[NRF_REG_RF_CH][0] = nrfField<NRFReg::RF_CH>(channel).bits;
+    image[NRF_REG_RF_SETUP][0] = nrfField<NRFReg::RF_DR_LOW>(dataRate == NRFController::NRF250kbps).bits |
+        nrfField<NRFReg::RF_DR_HIGH>(dataRate == NRFController::NRF2Mbps).bits |
+        nrfField<NRFReg::RF_PWR>(powerLevel).bits;
+    image[NRF_REG_DYNPD][0] = dynpd;
+    //the feature must be on while any pipe uses it
+    image[NRF_REG_FEATURE][0] = nrfField<NRFReg::EN_DPL>(dynpd != 0).bits |
+        nrfField<NRFReg::EN_ACK_PAY>(ackPayload).bits |
+        nrfField<NRFReg::EN_DYN_ACK>(dynamicAck).bits;
+
+    return true;
+}
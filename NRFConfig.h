@@ -0,0 +1,62 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_CONFIG_H
+#define NRF_CONFIG_H
+
+#include "NRFController.h"
+
+/**
+* @brief Setup of a single RX pipe
+*/
+struct NRFPipeConfig {
+    bool enabled;
+    bool autoAck;
+    bool dynamicPayload;
+    uint8_t payloadSize;
+    uint64_t address; //pipes 2 to 5 only use the LSB, other bytes come from pipe 1
+};
+
+/**
+* @brief Complete radio setup, applied at once by NRFController::applyConfig()
+* A default constructed config holds the chip reset values. Keep one instance
+* per profile and apply whichever is needed; only registers that differ from
+* the chip are written.
+*/
+struct NRFConfig {
+    NRFConfig();
+
+    bool encode(uint8_t image[NRF_REG_COUNT][NRF_MAX_ADDRESS_SIZE]) const;
+
+    int channel;
+    NRFController::NRFDataRate dataRate;
+    NRFController::NRFPowerLevel powerLevel;
+    int crcBytes;
+    int addressWidth;
+    int retries;
+    int retransmitDelayUs;
+    bool ackPayload;
+    bool dynamicAck; //allow packages sent without acknowledgement
+    uint8_t irqMask; //NRF_STATUS_* events kept off the IRQ pin
+    bool powerUp;
+    NRFController::NRFMode mode;
+    uint64_t txAddress;
+    NRFPipeConfig pipes[NRF_PIPE_COUNT];
+};
+
+#endif
@@ -17,7 +17,18 @@
 */
 
 #include "NRFController.h"
+#include "NRFConfig.h"
 #include <iostream>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+static uint64_t monotonicUs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
 
 /**
 * @brief Read a register from the NRF24L01+ module
@@ -29,18 +40,25 @@
 * @return true for success, false otherwise
 */
 bool NRFController::readRegister(uint8_t regNumber, uint8_t regBuffer[], int size) {
-    uint8_t tx[size+1];
-    uint8_t rx[size+1];
-    
-    for (int i=0;i<size+1;i++) {
-        tx[i] = 0;
-        rx[i] = 0;
+    //bytes clocked out after the command are ignored, no need to clear them
+    uint8_t frame[NRF_MAX_ADDRESS_SIZE+1];
+
+    if (size > NRF_MAX_ADDRESS_SIZE) {
+        return false;
     }
-    tx[0] = NRF_R_REGISTER | regNumber;
+    frame[0] = NRF_R_REGISTER | regNumber;
 
-    if (m_device->transact(tx, rx, size+1)) {
+    if (m_device->transact(frame, frame, size+1)) {
+        captureStatus(frame[0]);
         for (int i=0;i<size;i++) {
-            regBuffer[i] = rx[i+1];
+            regBuffer[i] = frame[i+1];
+        }
+        //keep the shadow copy coherent with what the chip just told us
+        if (!isVolatileRegister(regNumber)) {
+            for (int i=0;i<size;i++) {
+                m_shadow[regNumber][i] = regBuffer[i];
+            }
+            m_shadowValid |= (1UL << regNumber);
         }
         return true;
     }
@@ -57,417 +75,2215 @@ bool NRFController::readRegister(uint8_t regNumber, uint8_t regBuffer[], int siz
 * @return true for success, false otherwise
 */
 bool NRFController::writeRegister(uint8_t regNumber, const uint8_t regValue[], int size) {
-    uint8_t tx[size+1];
-    uint8_t rx[size+1];
+    uint8_t frame[NRF_MAX_ADDRESS_SIZE+1];
 
-    for (int i=0;i<size+1;i++) {
-        tx[i] = 0;
-        rx[i] = 0;
+    if (size > NRF_MAX_ADDRESS_SIZE) {
+        return false;
     }
-    tx[0] = NRF_W_REGISTER | regNumber;
+    frame[0] = NRF_W_REGISTER | regNumber;
+    memcpy(frame+1, regValue, size);
 
-    for (int i=0;i<size;i++) {
-        tx[i+1] = regValue[i];
-    }
- 
-    if (m_device->transact(tx, rx, size+1)) {
-       return true;
+    if (m_device->transact(frame, frame, size+1)) {
+        captureStatus(frame[0]);
+        if (regNumber == NRF_REG_STATUS) {
+            //interrupt flags are cleared by writing 1 to them
+            m_status &= ~(regValue[0] & NRF_STATUS_IRQ_MASK);
+        }
+        if (!isVolatileRegister(regNumber)) {
+            for (int i=0;i<size;i++) {
+                m_shadow[regNumber][i] = regValue[i];
+            }
+            m_shadowValid |= (1UL << regNumber);
+        }
+        return true;
     }
 
+    //we don't know what reached the chip, so don't trust our copy anymore
+    invalidateRegister(regNumber);
     return false;
 }
 
 /**
-* @brief instantiate a controller for the NRF24L01+ module
+* @brief Tell if a register may change without the controller writing to it
+* Volatile registers are never kept in the shadow copy and are always read
+* from the chip.
 *
-* @param dev Linux SPI device to use for communication
-* @todo move device opening to another method
+* @param regNumber register to check. Should be one of NRF_REG_* defines
+*
+* @return true if the register is volatile (or unknown), false otherwise
 */
-NRFController::NRFController(const char* dev) {
-    m_device = new HWAbstraction(dev);
-    if (m_device->openDevice() != 0) {
-        std::cout << "Can't open device" << std::endl;
+bool NRFController::isVolatileRegister(uint8_t regNumber) {
+    switch (regNumber) {
+        case NRF_REG_STATUS:
+        case NRF_REG_OBSERVE_TX:
+        case NRF_REG_CD:
+        case NRF_REG_FIFO_STATUS:
+        //gap between FIFO_STATUS and DYNPD
+        case 0x18:
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+            return true;
+        default:
+            return regNumber >= NRF_REG_COUNT;
     }
 }
 
 /**
-* @brief releases all resources used by the controller
+* @brief Retrieve a single byte register, using the shadow copy when possible
+* Only volatile registers or registers not seen yet will cost a SPI transaction
+*
+* @param regNumber which register to read. Should be one of NRF_REG_* defines
+* @param value where register value will be stored
+*
+* @return true for success, false otherwise
 */
-NRFController::~NRFController() {
-    if (m_device) {
-        m_device->closeDevice();
-        delete(m_device);
+bool NRFController::getRegister(uint8_t regNumber, uint8_t& value) {
+    if (!isVolatileRegister(regNumber) && (m_shadowValid & (1UL << regNumber))) {
+        value = m_shadow[regNumber][0];
+        return true;
     }
+
+    return readRegister(regNumber, &value);
 }
 
 /**
-* @brief Configure payload size to be used in transmissions
+* @brief Write a single byte register, skipping the SPI transaction if the
+* shadow copy shows the chip already holds that value
 *
-* @param packetSize payload size, in bytes. Valid sizes are from 0 (disable pipe) to 32
-* @param pipe which pipe to configure the payload size
+* @param regNumber which register to write. Should be one of NRF_REG_* defines
+* @param value new register value
 *
-* @return 
+* @return true for success, false otherwise
 */
-bool NRFController::setPacketSize(uint8_t packetSize, uint8_t pipe) {
-    uint8_t regRxPw;
-
-    //the chip supports up to 6 pipes
-    if (pipe > 5) {
-        return false;
+bool NRFController::updateRegister(uint8_t regNumber, uint8_t value) {
+    if (shadowMatches(regNumber, value)) {
+        return true;
     }
-    readRegister(NRF_REG_RX_PW_P0 + pipe, &regRxPw, 1);
-    
-    packetSize &= 0x1F; //use only 5 LSb for address
-    regRxPw |= packetSize;
 
-    writeRegister(NRF_REG_RX_PW_P0 + pipe, &packetSize, 1);
-
-    m_packetSize = packetSize;
-    return true;
+    return writeRegister(regNumber, &value);
 }
 
 /**
-* @brief Configure CRC mode to be used
-* unless you need to squeeze the maximum possible data rate, use 2 bytes for
-* CRC. This will help avoid spurious and invalid packages
+* @brief Change some bits of a single byte register, with one write at most
 *
-* @param crcBytes how many bytes to use in CRC. Valid values are 0, 1 and 2
+* @param regNumber which register to write. Should be one of NRF_REG_* defines
+* @param mask bits to change
+* @param bits new value of the bits in mask
 *
 * @return true for success, false otherwise
 */
-bool NRFController::setCRC(int crcBytes) {
-    uint8_t regConfig;
-
-    readRegister(NRF_REG_CONFIG, &regConfig);
-    switch (crcBytes) {
-    case 0:
-        regConfig = regConfig & (~0x08); //disable crc
-        break;
-    case 1:
-        regConfig |= 0x08; //enable crc
-        regConfig = regConfig & (~0x04); //crc size = 1 byte
-        break;
-    case 2:
-        regConfig |= 0x08; //enable crc
-        regConfig |= 0x04; //crc size = 2 bytes
-        break;
+bool NRFController::updateBits(uint8_t regNumber, uint8_t mask, uint8_t bits) {
+    uint8_t value;
 
-    default:
+    if (!getRegister(regNumber, value)) {
         return false;
     }
 
-    writeRegister(NRF_REG_CONFIG, &regConfig);
-    return true;
+    return updateRegister(regNumber, (value & ~mask) | (bits & mask));
 }
 
 /**
-* @brief Configure data rate to be used
-* the slower the data rate, the longer range you achieve
+* @brief Tell if the shadow copy shows the chip already holds a value
 *
-* @param rate which data rate to use
+* @param regNumber which register to check. Should be one of NRF_REG_* defines
+* @param value value to compare with
 *
-* @return true for success, false otherwise
+* @return true if a write of value to regNumber would change nothing
 */
-bool NRFController::setDataRate(NRFDataRate rate) {
-    uint8_t regRfSetup;
+bool NRFController::shadowMatches(uint8_t regNumber, uint8_t value) {
+    return !isVolatileRegister(regNumber) && (m_shadowValid & (1UL << regNumber)) &&
+            m_shadow[regNumber][0] == value;
+}
 
-    readRegister(NRF_REG_RF_SETUP, &regRfSetup);
-    switch (rate) {
-        case NRF1Mbps:
-            regRfSetup = regRfSetup & (~0x08);
-            break;
-        case NRF2Mbps:
-            regRfSetup |= 0x08;
-            break;
-    }
+/**
+* @brief Tell if the shadow copy shows the chip already holds a multi byte value
+*
+* @param regNumber which register to check. Should be one of NRF_REG_* defines
+* @param value value to compare with
+* @param size how many bytes to compare
+*
+* @return true if a write of value to regNumber would change nothing
+*/
+bool NRFController::shadowMatches(uint8_t regNumber, const uint8_t value[], int size) {
+    return !isVolatileRegister(regNumber) && (m_shadowValid & (1UL << regNumber)) &&
+            memcmp(m_shadow[regNumber], value, size) == 0;
+}
 
-    writeRegister(NRF_REG_RF_SETUP, &regRfSetup);
-    return true;
+/**
+* @brief Size of a register, in bytes, as it's read back from the chip
+*
+* @param regNumber which register. Should be one of NRF_REG_* defines
+*
+* @return register size in bytes
+*/
+int NRFController::registerSize(uint8_t regNumber) {
+    switch (regNumber) {
+        case NRF_REG_RX_ADDR_P0:
+        case NRF_REG_RX_ADDR_P1:
+        case NRF_REG_TX_ADDR:
+            return NRF_MAX_ADDRESS_SIZE;
+        default:
+            return 1;
+    }
 }
 
 /**
-* @brief Configure how many times the module tries to send a package not ACK'ed
+* @brief Queue a register read to be sent by submitQueue()
+* After submitQueue() the value is available in the shadow copy (for stable
+* registers) and through m_device->response(), skipping the STATUS byte
 *
-* @param retries how many retries. Valid values are from 0 to 15
+* @param regNumber which register to read. Should be one of NRF_REG_* defines
+* @param size size of register, in bytes
 *
-* @return true for success, false otherwise
+* @return transaction id, or -1 if it couldn't be queued
 */
-bool NRFController::setRetries(int retries) {
-    uint8_t regSetupRetR;
-    
-    //validate input
-    if (retries < 0 || retries > 15) {
-        return false;
+int NRFController::queueReadRegister(uint8_t regNumber, int size) {
+    uint8_t tx[NRF_MAX_ADDRESS_SIZE+1];
+    QueuedRegister queued;
+
+    if (size > NRF_MAX_ADDRESS_SIZE) {
+        return -1;
     }
 
-    //get current register value
-    readRegister(NRF_REG_SETUP_RETR, &regSetupRetR);
+    memset(tx, 0, size+1);
+    tx[0] = NRF_R_REGISTER | regNumber;
 
-    //clear ARC field (bits 3:0)
-    regSetupRetR = regSetupRetR & (~0x0F);
-    //set retries count
-    regSetupRetR |= retries;
+    queued.transactId = m_device->queueTransact(tx, size+1);
+    if (queued.transactId < 0) {
+        return -1;
+    }
+    queued.regNumber = regNumber;
+    queued.size = size;
+    queued.write = false;
+    m_queuedRegisters.push_back(queued);
 
-    //update register
-    writeRegister(NRF_REG_SETUP_RETR, &regSetupRetR);
-    return true;
+    return queued.transactId;
 }
 
 /**
-* @brief Enable or disable auto ack feature
+* @brief Queue a register write to be sent by submitQueue()
 *
-* @param autoAck true to enable, false to disable
-* @param pipe which pipe to configure
+* @param regNumber which register to write. Should be one of NRF_REG_* defines
+* @param regValue[] buffer holding register data to be written
+* @param size size of register, in bytes
+* @param delayUs how long to wait after the write before the next queued command
 *
-* @return true for success, false otherwise
+* @return transaction id, or -1 if it couldn't be queued
 */
-bool NRFController::setAutoAck(bool autoAck, uint8_t pipe) {
-    uint8_t regEnAA;
+int NRFController::queueWriteRegister(uint8_t regNumber, const uint8_t regValue[], int size, int delayUs) {
+    uint8_t tx[NRF_MAX_ADDRESS_SIZE+1];
+    QueuedRegister queued;
 
-    //validate input
-    if (pipe > 5) {
-        return false;
+    if (size > NRF_MAX_ADDRESS_SIZE) {
+        return -1;
     }
-    
-    //read current value
-    readRegister(NRF_REG_EN_AA, &regEnAA);
 
-    if (autoAck) {
-        regEnAA = regEnAA | (1 << pipe);
-    }
-    else {
-        regEnAA = regEnAA & ~(1 << pipe);
+    tx[0] = NRF_W_REGISTER | regNumber;
+    memcpy(tx+1, regValue, size);
+
+    queued.transactId = m_device->queueTransact(tx, size+1, delayUs);
+    if (queued.transactId < 0) {
+        return -1;
     }
+    queued.regNumber = regNumber;
+    queued.size = size;
+    queued.write = true;
+    memcpy(queued.value, regValue, size);
+    m_queuedRegisters.push_back(queued);
 
-    //update register
-    writeRegister(NRF_REG_EN_AA, &regEnAA);
-    return true;
+    return queued.transactId;
 }
 
 /**
-* @brief Configure the number of bytes to be used in the address field
-*
-* @param width how many bytes to use. Valid values currently are 3, 4 ou 5
+* @brief Send every queued transaction in a single SPI submission and update
+* the shadow copy with the registers read or written
 *
 * @return true for success, false otherwise
 */
-bool NRFController::setAddressWidth(int width) {
-    uint8_t regSetupAW;
+bool NRFController::submitQueue() {
+    bool ok = m_device->submit();
+    int last = m_device->queuedTransacts() - 1;
 
-    readRegister(NRF_REG_SETUP_AW, &regSetupAW);
-    regSetupAW = regSetupAW & (~0x03);
+    //every command clocks STATUS out first, the last one is the freshest
+    if (ok && last >= 0) {
+        captureStatus(m_device->response(last)[0]);
+    }
 
-    switch (width) {
-        case 3:
-            regSetupAW |= 0x01;
-            break;
-        case 4:
-            regSetupAW |= 0x02;
-            break;
-        case 5:
-            regSetupAW |= 0x03;
-            break;
-        default:
-            return false;
+    for (size_t i=0;i<m_queuedRegisters.size();i++) {
+        const QueuedRegister& queued = m_queuedRegisters[i];
+        if (ok && queued.write && queued.regNumber == NRF_REG_STATUS &&
+                queued.transactId == last) {
+            //STATUS was clocked out before the flags were cleared
+            m_status &= ~(queued.value[0] & NRF_STATUS_IRQ_MASK);
+        }
+
+        if (isVolatileRegister(queued.regNumber)) {
+            continue;
+        }
+
+        if (!ok) {
+            invalidateRegister(queued.regNumber);
+            continue;
+        }
+
+        const uint8_t* value = queued.value;
+        if (!queued.write) {
+            value = m_device->response(queued.transactId) + 1;
+        }
+        memcpy(m_shadow[queued.regNumber], value, queued.size);
+        m_shadowValid |= (1UL << queued.regNumber);
     }
+    m_queuedRegisters.clear();
 
-    writeRegister(NRF_REG_SETUP_AW, &regSetupAW);
-    return true;
+    return ok;
 }
 
 /**
-* @brief retrieve the number of bytes used for device address
+* @brief Drop every queued transaction without sending it, keeping the shadow
+* copy as it is
+*/
+void NRFController::discardQueue() {
+    m_device->discardQueue();
+    m_queuedRegisters.clear();
+}
+
+/**
+* @brief Reload the shadow copy of every stable register from the chip
+* Call this if something else may have touched the module registers (another
+* process, a power loss, etc)
 *
-* @return the number of bytes used for address
+* @return true for success, false otherwise
 */
-uint8_t NRFController::addressWidth() {
-    uint8_t regSetupAW;
+bool NRFController::syncRegisters() {
+    invalidateRegisters();
+    for (uint8_t reg=NRF_REG_CONFIG;reg<NRF_REG_COUNT;reg++) {
+        if (isVolatileRegister(reg)) {
+            continue;
+        }
 
-    readRegister(NRF_REG_SETUP_AW, &regSetupAW);
-    switch (regSetupAW & 0x03) {
-        case 1:
-            return 3;
-            break;
-        case 2:
-            return 4;
-            break;
-        case 3:
-            return 5;
-            break;
-        default:
-            return 0;
+        queueReadRegister(reg, registerSize(reg));
     }
+
+    return submitQueue();
 }
 
 /**
-* @brief Set the address used for a RX pipe
-* Address width must be set to n bytes before setting the actual address
+* @brief Bring the module to a complete configuration in a single SPI
+* submission. Registers the shadow copy shows as already holding the right
+* value are skipped, so switching between profiles only costs the registers
+* that differ. Registers not in the shadow copy are always written; call
+* syncRegisters() first to avoid that. Powering the module up waits the
+* 1.5ms it needs before returning.
+* CE is dropped while registers change, and always left high for RX mode and
+* low for TX mode.
 *
-* @param address address for the pipe.
-* @param n number of bytes to use for addressing
-* @param pipe which pipe to set the address. Pipes 0 and 1 will use the complete address, but other pipes will only set LSB. Other bytes will be mirrored from pipe 1 address
+* @param config setup to apply
 *
 * @return true for success, false otherwise
 */
-bool NRFController::setRxAddress(uint64_t address, uint8_t n, uint8_t pipe) {
-    uint8_t buffer[5];
+bool NRFController::applyConfig(const NRFConfig& config) {
+    int changed = queueConfig(config);
 
-    if (!setAddressWidth(n)) {
+    if (changed < 0) {
         return false;
     }
 
-    for (int i=0;i<n;i++) {
-        buffer[i] = address & 0xFF;
-        address >>=8;
+    if (changed > 0) {
+        setCE(false);
+        if (!submitQueue()) {
+            return false;
+        }
     }
 
-    writeRegister(NRF_REG_RX_ADDR_P0 + pipe, buffer, n);
-    return true;
+    return setCE(config.mode == NRFRxMode);
 }
 
 /**
-* @brief Configure the RF channel to be used by NRF24L01+ module
+* @brief Take over a module that may still be configured, for instance by a
+* previous run of the same program. The register file is read back in one
+* submission and only what differs from config is written in another, with
+* no power cycle. The 1.5ms power up delay is only paid if the module was
+* powered down, as the CONFIG write carries it.
 *
-* @param channel channel number, from 0 to 127. Check which address you're allowed to use in your country
+* @param config setup the module must end up with
 *
-* @return true for successm false otherwise
+* @return how many registers had to be written, 0 if the module was already
+* configured, or -1 on error
 */
-bool NRFController::setChannel(int channel) {
-    uint8_t regRfCh;
+int NRFController::warmStart(const NRFConfig& config) {
+    int changed;
 
-    //valide input
-    if (channel < 0 || channel > NRF_MAX_CHANNEL) {
-        return false;
+    if (!syncRegisters()) {
+        return -1;
     }
 
-    regRfCh = channel & 0x7F;
+    changed = queueConfig(config);
+    if (changed < 0) {
+        return -1;
+    }
 
-    //update register
-    writeRegister(NRF_REG_RF_CH, &regRfCh);
-    return true;
+    //CE was released when the previous owner went away
+    setCE(false);
+    if (changed > 0 && !submitQueue()) {
+        return -1;
+    }
+
+    if (config.mode == NRFRxMode) {
+        setCE(true);
+    }
+
+    return changed;
 }
 
 /**
-* @brief read a packet from the NRF module
-* this method will not block in case data is not available. It'll just return 0
+* @brief Queue writes for every register that doesn't hold what config asks
+* for, according to the shadow copy. A CONFIG write that powers the module up
+* is followed by the power up delay.
 *
-* @param buffer pre-allocated buffer where data will be written. It must be able to hold a complete package, as set by setPacketSize()]
+* @param config setup to compare with
 *
-* @return how many bytes were effectively read
+* @return how many registers were queued, or -1 if config is invalid or the
+* writes couldn't be queued. Nothing stays queued on error
 */
-int NRFController::readData(uint8_t* buffer) {
-    uint8_t tx[m_packetSize+1];
-    uint8_t rx[m_packetSize+1];
+int NRFController::queueConfig(const NRFConfig& config) {
+    //FEATURE goes before DYNPD, and CONFIG last so the mode changes only
+    //once everything else is in place
+    static const uint8_t order[] = {
+        NRF_REG_FEATURE, NRF_REG_DYNPD, NRF_REG_EN_AA, NRF_REG_EN_RXADDR,
+        NRF_REG_SETUP_AW, NRF_REG_SETUP_RETR, NRF_REG_RF_CH, NRF_REG_RF_SETUP,
+        NRF_REG_RX_ADDR_P0, NRF_REG_RX_ADDR_P1, NRF_REG_RX_ADDR_P2, NRF_REG_RX_ADDR_P3,
+        NRF_REG_RX_ADDR_P4, NRF_REG_RX_ADDR_P5, NRF_REG_TX_ADDR,
+        NRF_REG_RX_PW_P0, NRF_REG_RX_PW_P1, NRF_REG_RX_PW_P2, NRF_REG_RX_PW_P3,
+        NRF_REG_RX_PW_P4, NRF_REG_RX_PW_P5, NRF_REG_CONFIG
+    };
+    uint8_t image[NRF_REG_COUNT][NRF_MAX_ADDRESS_SIZE];
+    int queued = 0;
 
-    if (!dataAvailable()) {
-        return 0;
+    if (!config.encode(image)) {
+        return -1;
     }
 
-    tx[0] = NRF_R_RX_PAYLOAD;
-    m_device->transact(tx, rx, m_packetSize+1);
+    for (size_t i=0;i<sizeof(order);i++) {
+        uint8_t reg = order[i];
+        int delayUs = 0;
+
+        if (shadowMatches(reg, image[reg], registerSize(reg))) {
+            continue;
+        }
+
+        //a module whose CONFIG isn't known may be powered down
+        if (reg == NRF_REG_CONFIG && nrfFieldValue<NRFReg::PWR_UP>(image[reg][0]) &&
+                (!(m_shadowValid & (1UL << reg)) || !nrfFieldValue<NRFReg::PWR_UP>(m_shadow[reg][0]))) {
+            delayUs = NRF_POWER_UP_US;
+        }
+        if (queueWriteRegister(reg, image[reg], registerSize(reg), delayUs) < 0) {
+            discardQueue();
+            return -1;
+        }
+        queued++;
+    }
 
-    for (int i=0;i<m_packetSize;i++) {
-        buffer[i] = rx[i+1];
+    for (int i=0;i<NRF_PIPE_COUNT;i++) {
+        m_packetSize[i] = config.pipes[i].payloadSize;
     }
 
-    //TODO clear interrupt bit
-    return m_packetSize;
+    return queued;
 }
 
 /**
-* @brief write data to internal buffer.
-* data will be split in packages and sent.
-*
-* @param size how many bytes to be written
-* @param buffer buffer containing data to be written
+* @brief Forget the shadow copy of a register. Next access will read it again
+* from the chip
 *
-* @return how many bytes were effectively written
+* @param regNumber which register to invalidate. Should be one of NRF_REG_* defines
 */
-int NRFController::writeData(int size, const char* buffer) {
-    return 0;
+void NRFController::invalidateRegister(uint8_t regNumber) {
+    if (regNumber < NRF_REG_COUNT) {
+        m_shadowValid &= ~(1UL << regNumber);
+    }
 }
 
 /**
-* @brief low level method to dispatch a single package
-*
-* @param data buffer containing data. It must have the size specified in setPackageSize()
-*
-* @return true for success, false otherwise
+* @brief Forget the whole shadow copy
 */
-bool NRFController::sendPkg(const char* data) {
-    return false;
+void NRFController::invalidateRegisters() {
+    m_shadowValid = 0;
 }
 
 /**
-* @brief check if there are any package available for reading
+* @brief Drive the CE line, keeping track of its level since the transport
+* can't read it back
 *
-* @return true if there's anything to be read, false otherwise
+* @param high true to raise CE, false to drop it
+*
+* @return true for success, false otherwise
 */
-bool NRFController::dataAvailable() {
-    uint8_t regFifoStatus;
-    
-    readRegister(NRF_REG_FIFO_STATUS, &regFifoStatus);
-    if (!(regFifoStatus & 0x01)) {
-        return 1;
+bool NRFController::setCE(bool high) {
+    if (!(high ? m_device->setCE() : m_device->clearCE())) {
+        return false;
     }
-    return 0;
+
+    m_ce = high;
+    return true;
 }
 
 /**
-* @brief Activate ou deactivate de module power
-* Module must be activated before transmiting or receiving anything
-*
-* @param powerUp true to enable power, false to disable
+* @brief Raise CE long enough to start a transmission, then drop it again
 *
 * @return true for success, false otherwise
 */
-bool NRFController::setPowerUp(bool powerUp) {
-    uint8_t regConfig;
+bool NRFController::pulseCE() {
+    bool ok = m_device->pulseCE(NRF_CE_PULSE_US);
 
-    readRegister(NRF_REG_CONFIG, &regConfig);
+    m_ce = false;
+    return ok;
+}
 
-    if (powerUp) {
-        regConfig = regConfig | 0x02;
+/**
+* @brief instantiate a controller for the NRF24L01+ module
+*
+* @param dev Linux SPI device to use for communication
+* @param spiSpeed SPI clock, in Hz. NRF_SPI_AUTO_SPEED runs calibrateSpiSpeed()
+* right after the device is opened
+* @param gpioChip GPIO chip device the CE pin belongs to, like /dev/gpiochip0
+* @param ceLine line offset of the CE pin inside the chip
+* @todo move device opening to another method
+*/
+NRFController::NRFController(const char* dev, uint32_t spiSpeed, const char* gpioChip, int ceLine) {
+    init();
+    m_device = new HWAbstraction(dev, spiSpeed == NRF_SPI_AUTO_SPEED ? NRF_SPI_DEFAULT_SPEED : spiSpeed,
+            gpioChip, ceLine);
+    m_ownsDevice = true;
+    if (m_device->openDevice() != 0) {
+        std::cout << "Can't open device" << std::endl;
     }
-    else {
-        regConfig = regConfig & ~0x02;
+    else if (spiSpeed == NRF_SPI_AUTO_SPEED && calibrateSpiSpeed() == 0) {
+        std::cout << "Can't calibrate SPI speed" << std::endl;
     }
-    
-    writeRegister(NRF_REG_CONFIG, &regConfig);
-
-    return true;
 }
 
 /**
-* @brief 
+* @brief instantiate a controller for a NRF24L01+ module reached through an
+* already opened transport, like NRFSimulator
 *
-* @param mode
-*
-* @return 
+* @param transport transport to use for communication. It's not owned by the
+* controller and must outlive it
 */
-bool NRFController::setMode(NRFMode mode) {
-    uint8_t regConfig;
+NRFController::NRFController(NRFTransport* transport) {
+    init();
+    m_device = transport;
+    m_ownsDevice = false;
+}
 
-    //retrieve current config
-    readRegister(NRF_REG_CONFIG, &regConfig);
+/**
+* @brief releases all resources used by the controller
+*/
+NRFController::~NRFController() {
+    if (m_device && m_ownsDevice) {
+        m_device->closeDevice();
+        delete(m_device);
+    }
+}
 
-    switch (mode) {
-        case NRFTxMode:
-            regConfig = regConfig & ~0x01;
-            break;
+void NRFController::init() {
+    memset(m_packetSize, 0, sizeof(m_packetSize));
+    m_status = NRF_STATUS_RX_P_NO_EMPTY;
+    m_shadowValid = 0;
+    //the transport opens with CE low
+    m_ce = false;
+}
 
-        case NRFRxMode:
-            regConfig = regConfig | 0x01;
-            m_device->setCE();
-            break;
+/**
+* @brief Change the SPI clock used to talk to the module
+*
+* @param hz clock frequency, in Hz. The module accepts up to 10MHz, but long
+* wires may not
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setSpiSpeed(uint32_t hz) {
+    return m_device->setSpeed(hz);
+}
 
-        default:
-            return false;
-    }
-    
-    //update config register
-    writeRegister(NRF_REG_CONFIG, &regConfig);
+/**
+* @return SPI clock frequency in Hz, 0 if the transport has none
+*/
+uint32_t NRFController::spiSpeed() const {
+    return m_device->speed();
+}
 
+/**
+* @brief Find the fastest SPI clock the wiring can take
+* Steps the clock up and, at each step, writes patterns to TX_ADDR and reads
+* them back. The last speed where every pattern survived is kept. Garbled
+* commands may hit other registers, so run it before configuring the module.
+* TX_ADDR is restored and the shadow copy is dropped at the end.
+*
+* @param maxHz fastest clock to try, in Hz
+*
+* @return the chosen speed in Hz, or 0 if even the slowest one failed
+*/
+uint32_t NRFController::calibrateSpiSpeed(uint32_t maxHz) {
+    static const uint32_t speeds[] = {1000000, 2000000, 4000000, 5000000, 8000000, 10000000};
+    uint32_t original = m_device->speed();
+    uint32_t best = 0;
+    uint8_t regTxAddr[NRF_MAX_ADDRESS_SIZE];
+
+    if (!readRegister(NRF_REG_TX_ADDR, regTxAddr, NRF_MAX_ADDRESS_SIZE)) {
+        return 0;
+    }
+
+    for (size_t i=0;i<sizeof(speeds)/sizeof(speeds[0]) && speeds[i]<=maxHz;i++) {
+        if (!m_device->setSpeed(speeds[i]) || !verifySpi()) {
+            break;
+        }
+        best = speeds[i];
+    }
+
+    m_device->setSpeed(best ? best : original);
+    invalidateRegisters();
+    if (!writeRegister(NRF_REG_TX_ADDR, regTxAddr, NRF_MAX_ADDRESS_SIZE) || !refreshStatus()) {
+        return 0;
+    }
+
+    return best;
+}
+
+/**
+* @brief Write patterns to TX_ADDR and read them back, at current SPI speed
+* The shadow copy is bypassed, so a failure doesn't leave garbage in it.
+*
+* @return true if every pattern came back intact
+*/
+bool NRFController::verifySpi() {
+    static const uint8_t patterns[][NRF_MAX_ADDRESS_SIZE] = {
+        {0x55, 0xAA, 0x55, 0xAA, 0x55},
+        {0xAA, 0x55, 0xAA, 0x55, 0xAA},
+        {0xFF, 0x00, 0xFF, 0x00, 0xFF},
+        {0x00, 0xFF, 0x00, 0xFF, 0x00},
+        {0x01, 0x02, 0x04, 0x08, 0x10},
+        {0xFE, 0xFD, 0xFB, 0xF7, 0xEF}
+    };
+    const int count = sizeof(patterns) / sizeof(patterns[0]);
+    uint8_t tx[NRF_MAX_ADDRESS_SIZE+1];
+    int readIds[count];
+
+    for (int round=0;round<NRF_SPI_CALIBRATE_ROUNDS;round++) {
+        for (int i=0;i<count;i++) {
+            tx[0] = NRF_W_REGISTER | NRF_REG_TX_ADDR;
+            memcpy(tx+1, patterns[i], NRF_MAX_ADDRESS_SIZE);
+            m_device->queueTransact(tx, NRF_MAX_ADDRESS_SIZE+1);
+
+            memset(tx, 0, sizeof(tx));
+            tx[0] = NRF_R_REGISTER | NRF_REG_TX_ADDR;
+            readIds[i] = m_device->queueTransact(tx, NRF_MAX_ADDRESS_SIZE+1);
+        }
+
+        if (!m_device->submit()) {
+            return false;
+        }
+
+        for (int i=0;i<count;i++) {
+            const uint8_t* rx = m_device->response(readIds[i]);
+            //STATUS bit 7 always reads 0
+            if (rx == NULL || (rx[0] & 0x80) ||
+                    memcmp(rx+1, patterns[i], NRF_MAX_ADDRESS_SIZE) != 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+* @brief Configure payload size to be used in transmissions
+*
+* Pipe 0 size is also used for transmission. It's ignored for pipes using
+* dynamic payload length.
+*
+* @param packetSize payload size, in bytes. Valid sizes are from 0 (disable pipe) to 32
+* @param pipe which pipe to configure the payload size
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setPacketSize(uint8_t packetSize, uint8_t pipe) {
+    //the chip supports up to 6 pipes
+    if (pipe >= NRF_PIPE_COUNT || packetSize > NRF_MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    if (!updateRegister(NRF_REG_RX_PW_P0 + pipe, packetSize)) {
+        return false;
+    }
+
+    m_packetSize[pipe] = packetSize;
+    return true;
+}
+
+/**
+* @brief Enable or disable dynamic payload length for a pipe
+* With dynamic payload length each package carries its own size, so short
+* messages don't need padding. Auto ack must be enabled on the pipe, and the
+* transmitter must enable it on pipe 0.
+*
+* @param enable true to enable, false to disable
+* @param pipe which pipe to configure
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setDynamicPayload(bool enable, uint8_t pipe) {
+    uint8_t regDynpd;
+    uint8_t regFeature;
+
+    //validate input
+    if (pipe >= NRF_PIPE_COUNT) {
+        return false;
+    }
+
+    if (!getRegister(NRF_REG_DYNPD, regDynpd) || !getRegister(NRF_REG_FEATURE, regFeature)) {
+        return false;
+    }
+
+    if (enable) {
+        regDynpd |= (1 << pipe);
+    }
+    else {
+        regDynpd &= ~(1 << pipe);
+    }
+
+    //the feature must be on while any pipe uses it
+    if (regDynpd) {
+        regFeature |= NRF_FEATURE_EN_DPL;
+    }
+    else {
+        regFeature &= ~NRF_FEATURE_EN_DPL;
+    }
+
+    //DYNPD is only honored while EN_DPL is set, so order matters
+    if (enable && !shadowMatches(NRF_REG_FEATURE, regFeature)) {
+        queueWriteRegister(NRF_REG_FEATURE, &regFeature);
+    }
+    if (!shadowMatches(NRF_REG_DYNPD, regDynpd)) {
+        queueWriteRegister(NRF_REG_DYNPD, &regDynpd);
+    }
+    if (!enable && !shadowMatches(NRF_REG_FEATURE, regFeature)) {
+        queueWriteRegister(NRF_REG_FEATURE, &regFeature);
+    }
+
+    return submitQueue();
+}
+
+/**
+* @brief Tell if a pipe uses dynamic payload length
+*
+* @param pipe which pipe to check
+*
+* @return true if dynamic payload length is enabled for the pipe
+*/
+bool NRFController::dynamicPayload(uint8_t pipe) {
+    uint8_t regDynpd;
+    uint8_t regFeature;
+
+    if (pipe >= NRF_PIPE_COUNT) {
+        return false;
+    }
+
+    if (!getRegister(NRF_REG_FEATURE, regFeature) || !(regFeature & NRF_FEATURE_EN_DPL)) {
+        return false;
+    }
+
+    return getRegister(NRF_REG_DYNPD, regDynpd) && (regDynpd & (1 << pipe));
+}
+
+/**
+* @brief Configure CRC mode to be used
+* unless you need to squeeze the maximum possible data rate, use 2 bytes for
+* CRC. This will help avoid spurious and invalid packages
+*
+* @param crcBytes how many bytes to use in CRC. Valid values are 0, 1 and 2
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setCRC(int crcBytes) {
+    switch (crcBytes) {
+    case 0:
+        //CRCO is left alone, it means nothing while CRC is disabled
+        return setFields(nrfField<NRFReg::EN_CRC>(0));
+    case 1:
+    case 2:
+        return setFields(nrfField<NRFReg::EN_CRC>(1), nrfField<NRFReg::CRCO>(crcBytes - 1));
+
+    default:
+        return false;
+    }
+}
+
+/**
+* @brief Configure data rate to be used
+* the slower the data rate, the longer range you achieve
+*
+* @param rate which data rate to use
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setDataRate(NRFDataRate rate) {
+    switch (rate) {
+        case NRF1Mbps:
+            return setFields(nrfField<NRFReg::RF_DR_LOW>(0), nrfField<NRFReg::RF_DR_HIGH>(0));
+        case NRF2Mbps:
+            return setFields(nrfField<NRFReg::RF_DR_LOW>(0), nrfField<NRFReg::RF_DR_HIGH>(1));
+        case NRF250kbps:
+            return setFields(nrfField<NRFReg::RF_DR_LOW>(1), nrfField<NRFReg::RF_DR_HIGH>(0));
+        default:
+            return false;
+    }
+}
+
+/**
+* @brief Configure the transmitter output power
+* lower levels save current and interfere less with neighbour links
+*
+* @param level which power level to use
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setPowerLevel(NRFPowerLevel level) {
+    //validate input
+    if (level < NRFPowerMinus18dBm || level > NRFPower0dBm) {
+        return false;
+    }
+
+    return setFields(nrfField<NRFReg::RF_PWR>(level));
+}
+
+/**
+* @brief Configure how many times the module tries to send a package not ACK'ed
+*
+* @param retries how many retries. Valid values are from 0 to 15
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setRetries(int retries) {
+    //validate input
+    if (retries < 0 || retries > 15) {
+        return false;
+    }
+
+    return setFields(nrfField<NRFReg::ARC>(retries));
+}
+
+/**
+* @brief Configure how long the module waits for an ACK before retrying
+* the delay must cover the ACK air time, which grows with slower data rates
+* and with payloads attached to the ACK
+*
+* @param delayUs delay in microseconds. Valid values are 250 to 4000, in steps of 250
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setRetransmitDelay(int delayUs) {
+    //validate input
+    if (delayUs < 250 || delayUs > 4000 || delayUs % 250) {
+        return false;
+    }
+
+    return setFields(nrfField<NRFReg::ARD>(delayUs / 250 - 1));
+}
+
+/**
+* @brief Enable or disable auto ack feature
+*
+* @param autoAck true to enable, false to disable
+* @param pipe which pipe to configure
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setAutoAck(bool autoAck, uint8_t pipe) {
+    //validate input
+    if (pipe > 5) {
+        return false;
+    }
+
+    return updateBits(NRFReg::ENAA::reg, 1 << pipe, autoAck ? 0xFF : 0);
+}
+
+/**
+* @brief Configure the number of bytes to be used in the address field
+*
+* @param width how many bytes to use. Valid values currently are 3, 4 ou 5
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setAddressWidth(int width) {
+    //validate input
+    if (width < 3 || width > 5) {
+        return false;
+    }
+
+    //AW field holds width - 2
+    return setFields(nrfField<NRFReg::AW>(width - 2));
+}
+
+/**
+* @brief retrieve the number of bytes used for device address
+*
+* @return the number of bytes used for address
+*/
+uint8_t NRFController::addressWidth() {
+    uint8_t aw;
+
+    if (!getField<NRFReg::AW>(aw) || aw == 0) {
+        return 0;
+    }
+
+    return aw + 2;
+}
+
+/**
+* @brief Set the address used for a RX pipe, and enable the pipe
+* Pipes 0 and 1 set the address width to n bytes as well.
+*
+* @param address address for the pipe.
+* @param n number of bytes to use for addressing
+* @param pipe which pipe to set the address. Pipes 0 and 1 will use the complete address, but other pipes will only set LSB. Other bytes will be mirrored from pipe 1 address
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setRxAddress(uint64_t address, uint8_t n, uint8_t pipe) {
+    uint8_t buffer[5];
+    uint8_t regSetupAW;
+    uint8_t regEnRxAddr;
+
+    //validate input
+    if (n < 3 || n > 5 || pipe > 5) {
+        return false;
+    }
+
+    if (!getRegister(NRF_REG_SETUP_AW, regSetupAW) || !getRegister(NRF_REG_EN_RXADDR, regEnRxAddr)) {
+        return false;
+    }
+    //AW field holds width - 2
+    regSetupAW = (regSetupAW & ~NRFReg::AW::mask) | nrfField<NRFReg::AW>(n - 2).bits;
+    regEnRxAddr |= 1 << pipe;
+
+    //pipes 2 to 5 only hold the LSB
+    if (pipe >= 2) {
+        n = 1;
+    }
+    for (int i=0;i<n;i++) {
+        buffer[i] = address & 0xFF;
+        address >>=8;
+    }
+
+    //width, address and enabling go together in a single submission
+    if (pipe < 2 && !shadowMatches(NRF_REG_SETUP_AW, regSetupAW)) {
+        queueWriteRegister(NRF_REG_SETUP_AW, &regSetupAW);
+    }
+    if (!shadowMatches(NRF_REG_RX_ADDR_P0 + pipe, buffer, n)) {
+        queueWriteRegister(NRF_REG_RX_ADDR_P0 + pipe, buffer, n);
+    }
+    if (!shadowMatches(NRF_REG_EN_RXADDR, regEnRxAddr)) {
+        queueWriteRegister(NRF_REG_EN_RXADDR, &regEnRxAddr);
+    }
+
+    return submitQueue();
+}
+
+/**
+* @brief Enable or disable reception on a pipe
+*
+* @param enable true to enable, false to disable
+* @param pipe which pipe to configure
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setPipeEnabled(bool enable, uint8_t pipe) {
+    //validate input
+    if (pipe >= NRF_PIPE_COUNT) {
+        return false;
+    }
+
+    return updateBits(NRFReg::ERX::reg, 1 << pipe, enable ? 0xFF : 0);
+}
+
+/**
+* @brief Configure the RF channel to be used by NRF24L01+ module
+*
+* @param channel channel number, from 0 to NRF_MAX_CHANNEL (2400 to 2525MHz). Check which address you're allowed to use in your country
+*
+* @return true for successm false otherwise
+*/
+bool NRFController::setChannel(int channel) {
+    //valide input
+    if (channel < 0 || channel > NRF_MAX_CHANNEL) {
+        return false;
+    }
+
+    return setFields(nrfField<NRFReg::RF_CH>(channel));
+}
+
+/**
+* @brief Change the RF channel of a link that may be listening. In RX mode the
+* receiver leaves RX, gets the new RF_CH and enters RX again, so the
+* synthesizer relocks as after any RX entry, all in a single SPI submission
+* that returns once the receiver settled. Otherwise it's the same as
+* setChannel().
+*
+* @param channel channel number, from 0 to NRF_MAX_CHANNEL
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::hopChannel(int channel) {
+    uint8_t regConfig;
+
+    //validate input
+    if (channel < 0 || channel > NRF_MAX_CHANNEL) {
+        return false;
+    }
+
+    if (!getRegister(NRF_REG_CONFIG, regConfig)) {
+        return false;
+    }
+    if (!nrfFieldValue<NRFReg::PRIM_RX>(regConfig) || shadowMatches(NRF_REG_RF_CH, channel)) {
+        return setChannel(channel);
+    }
+
+    queueRetune(regConfig, channel, NRF_RX_SETTLE_US);
+    return submitQueue();
+}
+
+/**
+* @brief Queue the commands that move a receiver to another channel: leave RX
+* mode, change RF_CH and enter RX mode again, waiting settleUs after that.
+* CONFIG ends up as regConfig with PRIM_RX set.
+*
+* @param regConfig current CONFIG value
+* @param channel new channel
+* @param settleUs delay after entering RX mode again
+*/
+void NRFController::queueRetune(uint8_t regConfig, uint8_t channel, int settleUs) {
+    uint8_t regValue;
+
+    regValue = (regConfig & ~NRFReg::PRIM_RX::mask) | nrfField<NRFReg::PRIM_RX>(0).bits;
+    queueWriteRegister(NRF_REG_CONFIG, &regValue);
+    queueWriteRegister(NRF_REG_RF_CH, &channel);
+    regValue = (regConfig & ~NRFReg::PRIM_RX::mask) | nrfField<NRFReg::PRIM_RX>(1).bits;
+    queueWriteRegister(NRF_REG_CONFIG, &regValue, 1, settleUs);
+}
+
+/**
+* @brief Survey every channel for other transmitters, using the Received Power
+* Detector. Each channel costs four queued commands: leave RX mode (which
+* resets the RPD latch), change RF_CH, enter RX mode again and, after the
+* receiver settled and listened, read RPD. NRF_SCAN_BATCH channels go in a
+* single SPI submission, so dwell time is bounded by the chip, not by the bus.
+* The module must be powered up. Packages waiting in the TX FIFO are
+* discarded, while channel, mode and CE level are restored at the end.
+*
+* @param map receives how many passes found each channel busy
+* @param passes how many times to sweep the band
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::scanChannels(NRFChannelMap& map, int passes) {
+    uint8_t regConfig;
+    uint8_t regRfCh;
+    int cdIds[NRF_SCAN_BATCH];
+    bool ce = m_ce;
+    bool ok = true;
+
+    //validate input
+    if (passes <= 0) {
+        return false;
+    }
+
+    if (!getRegister(NRF_REG_CONFIG, regConfig) || !getRegister(NRF_REG_RF_CH, regRfCh)) {
+        return false;
+    }
+    //RPD needs a running receiver
+    if (!nrfFieldValue<NRFReg::PWR_UP>(regConfig)) {
+        return false;
+    }
+
+    //leaving RX mode with CE high must not send anything
+    if (!flushTx() || !setCE(true)) {
+        return false;
+    }
+
+    memset(map.busy, 0, sizeof(map.busy));
+    map.passes = passes;
+
+    for (int pass=0;pass<passes && ok;pass++) {
+        for (int first=0;first<NRF_CHANNEL_COUNT && ok;first+=NRF_SCAN_BATCH) {
+            int count = NRF_CHANNEL_COUNT - first;
+
+            if (count > NRF_SCAN_BATCH) {
+                count = NRF_SCAN_BATCH;
+            }
+            for (int i=0;i<count;i++) {
+                queueRetune(regConfig, first + i, NRF_RPD_SETTLE_US);
+                cdIds[i] = queueReadRegister(NRF_REG_CD);
+            }
+
+            ok = submitQueue();
+            for (int i=0;i<count && ok;i++) {
+                if (nrfFieldValue<NRFReg::RPD>(m_device->response(cdIds[i])[1])) {
+                    map.busy[first+i]++;
+                }
+            }
+        }
+    }
+
+    //restore channel, mode and CE, which may have been low even in RX mode
+    queueWriteRegister(NRF_REG_RF_CH, &regRfCh);
+    queueWriteRegister(NRF_REG_CONFIG, &regConfig);
+    ok = submitQueue() && ok;
+    if (!ce) {
+        ok = setCE(false) && ok;
+    }
+
+    return ok;
+}
+
+/**
+* @brief read a packet from the NRF module
+* this method will not block in case data is not available. It'll just return 0
+*
+* @param buffer pre-allocated buffer where data will be written. It must be able to hold a complete package, as set by setPacketSize()]
+* @param pipe if not NULL, receives the pipe number the package arrived on
+*
+* @return how many bytes were effectively read
+*/
+int NRFController::readData(uint8_t* buffer, uint8_t* pipe) {
+    NRFPacketBuffer packet;
+    int size = readPacket(packet);
+
+    if (size <= 0) {
+        return 0;
+    }
+
+    if (pipe) {
+        *pipe = packet.pipe;
+    }
+    memcpy(buffer, packet.data(), size);
+    return size;
+}
+
+/**
+* @brief read a packet straight into a packet buffer, without intermediate
+* copies. Like readData(), this method will not block in case data is not
+* available.
+*
+* @param packet buffer receiving the package. Its size and pipe are set too
+*
+* @return how many bytes were effectively read
+*/
+int NRFController::readPacket(NRFPacketBuffer& packet) {
+    uint8_t clearRxDr = NRF_STATUS_RX_DR;
+    int size;
+    NRF_STATS(uint64_t start = nrfStatsNowNs());
+
+    if (!dataAvailable()) {
+        return 0;
+    }
+
+    size = rxPayloadSize(pendingPipe());
+    if (size <= 0) {
+        return 0;
+    }
+
+    //fetch payload and clear interrupt bit in the same submission
+    packet.frame[0] = NRF_R_RX_PAYLOAD;
+    m_device->queueInPlace(packet.frame, size+1);
+    queueWriteRegister(NRF_REG_STATUS, &clearRxDr);
+
+    if (!submitQueue()) {
+        return 0;
+    }
+
+    //STATUS clocked out with the read command tells where the payload came from
+    packet.pipe = (packet.frame[0] & NRF_STATUS_RX_P_NO_MASK) >> 1;
+    packet.size = size;
+
+    NRF_STATS(m_stats.rxPackets++);
+    NRF_STATS(m_stats.rxLatency.record(nrfStatsNowNs() - start));
+    return size;
+}
+
+/**
+* @brief read every package waiting in the RX FIFO at once
+* All reads and the RX_DR clearing go in a single SPI submission. Like
+* readData(), this method will not block in case data is not available.
+*
+* @param packets pre-allocated array where packages will be stored
+* @param maxPackets how many packages fit in packets. The module holds up to NRF_RX_FIFO_DEPTH
+*
+* @return how many packages were effectively read
+*/
+int NRFController::readBurst(NRFPacket packets[], int maxPackets) {
+    NRFPacketBuffer buffers[NRF_RX_FIFO_DEPTH];
+    NRFPacketBuffer* slots[NRF_RX_FIFO_DEPTH];
+    int count;
+
+    for (int i=0;i<NRF_RX_FIFO_DEPTH;i++) {
+        slots[i] = &buffers[i];
+    }
+
+    count = readBurst(slots, maxPackets);
+    for (int i=0;i<count;i++) {
+        packets[i].pipe = slots[i]->pipe;
+        packets[i].size = slots[i]->size;
+        memcpy(packets[i].data, slots[i]->data(), slots[i]->size);
+    }
+
+    return count;
+}
+
+/**
+* @brief read every package waiting in the RX FIFO at once, straight into
+* packet buffers. Buffers that got a package are moved to the front of the
+* array, so the caller finds them in packets[0] to packets[count-1].
+*
+* @param packets buffers where packages will be stored
+* @param maxPackets how many buffers there are. The module holds up to NRF_RX_FIFO_DEPTH
+*
+* @return how many packages were effectively read
+*/
+int NRFController::readBurst(NRFPacketBuffer* packets[], int maxPackets) {
+    uint8_t widths[NRF_RX_FIFO_DEPTH][2];
+    uint8_t clearRxDr = NRF_STATUS_RX_DR;
+    bool dynamic[NRF_PIPE_COUNT];
+    bool anyDynamic = false;
+    bool flush = false;
+    int readSize = 0;
+    int count = 0;
+    NRF_STATS(uint64_t start = nrfStatsNowNs());
+
+    if (maxPackets <= 0 || !dataAvailable()) {
+        return 0;
+    }
+
+    if (maxPackets > NRF_RX_FIFO_DEPTH) {
+        maxPackets = NRF_RX_FIFO_DEPTH;
+    }
+
+    //read enough to hold a package from any pipe
+    for (int i=0;i<NRF_PIPE_COUNT;i++) {
+        dynamic[i] = dynamicPayload(i);
+        anyDynamic |= dynamic[i];
+        if (m_packetSize[i] > readSize) {
+            readSize = m_packetSize[i];
+        }
+    }
+    if (anyDynamic) {
+        readSize = NRF_MAX_PAYLOAD_SIZE;
+    }
+    if (readSize == 0) {
+        //no pipe has a width to read with
+        discardRxPayloads();
+        return 0;
+    }
+
+    //we can't know how deep the FIFO is, so read as much as it can hold. The
+    //STATUS clocked out with each read tells which ones were real
+    for (int i=0;i<maxPackets;i++) {
+        if (anyDynamic) {
+            widths[i][0] = NRF_R_RX_PL_WID;
+            m_device->queueInPlace(widths[i], 2);
+        }
+        packets[i]->frame[0] = NRF_R_RX_PAYLOAD;
+        m_device->queueInPlace(packets[i]->frame, readSize+1);
+    }
+    queueWriteRegister(NRF_REG_STATUS, &clearRxDr);
+
+    if (!submitQueue()) {
+        return 0;
+    }
+
+    for (int i=0;i<maxPackets;i++) {
+        NRFPacketBuffer* packet = packets[i];
+        if ((packet->frame[0] & NRF_STATUS_RX_P_NO_MASK) == NRF_STATUS_RX_P_NO_EMPTY) {
+            continue;
+        }
+
+        packet->pipe = (packet->frame[0] & NRF_STATUS_RX_P_NO_MASK) >> 1;
+        if (packet->pipe >= NRF_PIPE_COUNT) {
+            //RX_P_NO 6 is reserved, the FIFO can't be trusted
+            flush = true;
+            continue;
+        }
+        packet->size = m_packetSize[packet->pipe];
+        if (dynamic[packet->pipe]) {
+            packet->size = widths[i][1];
+            if (packet->size > NRF_MAX_PAYLOAD_SIZE) {
+                //corrupted package, the datasheet says FIFO must be flushed
+                flush = true;
+                continue;
+            }
+        }
+        //keep filled buffers together at the front
+        packets[i] = packets[count];
+        packets[count] = packet;
+        count++;
+    }
+
+    //every slot had something, the module may have been dropping packages
+    if (count == NRF_RX_FIFO_DEPTH) {
+        NRF_STATS(m_stats.rxFifoFull++);
+    }
+    NRF_STATS(m_stats.rxPackets += count);
+    NRF_STATS(m_stats.rxLatency.record(nrfStatsNowNs() - start));
+
+    if (flush) {
+        discardRxPayloads();
+    }
+
+    return count;
+}
+
+/**
+* @brief Size of the package at the head of the RX FIFO
+* For pipes using dynamic payload length it's asked to the module. A package
+* that can't be read (invalid pipe or size, or a pipe without width) is
+* dropped with the whole RX FIFO, so it doesn't stay pending forever.
+*
+* @param pipe pipe the package arrived on
+*
+* @return package size, or -1 if there's no valid package
+*/
+int NRFController::rxPayloadSize(int pipe) {
+    uint8_t tx[2] = {NRF_R_RX_PL_WID, NRF_DUMMY};
+    uint8_t rx[2];
+
+    if (pipe < 0) {
+        return -1;
+    }
+
+    if (pipe >= NRF_PIPE_COUNT) {
+        discardRxPayloads();
+        return -1;
+    }
+
+    if (!dynamicPayload(pipe)) {
+        if (m_packetSize[pipe] == 0) {
+            discardRxPayloads();
+            return -1;
+        }
+        return m_packetSize[pipe];
+    }
+
+    if (!m_device->transact(tx, rx, 2)) {
+        return -1;
+    }
+    captureStatus(rx[0]);
+
+    if (rx[1] > NRF_MAX_PAYLOAD_SIZE) {
+        //corrupted package, the datasheet says FIFO must be flushed
+        discardRxPayloads();
+        return -1;
+    }
+
+    return rx[1];
+}
+
+/**
+* @brief Flush the RX FIFO and clear RX_DR. STATUS is refreshed after the
+* flush, so pendingPipe() and dataAvailable() stop reporting the dropped
+* packages.
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::discardRxPayloads() {
+    uint8_t tx = NRF_FLUSH_RX;
+    uint8_t clearRxDr = NRF_STATUS_RX_DR;
+
+    //STATUS clocked out by the write comes after the flush
+    m_device->queueTransact(&tx, 1);
+    queueWriteRegister(NRF_REG_STATUS, &clearRxDr);
+    return submitQueue();
+}
+
+/**
+* @brief write data to internal buffer.
+* data will be split in packages and sent. CE is kept high and the TX FIFO is
+* topped up as packages are acknowledged, so the module never waits for us
+* between packages. Unless pipe 0 uses dynamic payload length, the last
+* package is padded with zeros. Module must be powered up and in TX mode.
+*
+* @param size how many bytes to be written
+* @param buffer buffer containing data to be written
+*
+* @return how many bytes were effectively written. Packages are only counted
+* once the module confirms they left the FIFO, so on failure this may be less
+* than what the receiver actually got
+*/
+int NRFController::writeData(int size, const char* buffer) {
+    return transmitData(size, buffer, false);
+}
+
+/**
+* @brief Stream data to any number of receivers, without acknowledgements
+* Works like writeData(), but packages are sent with W_TX_PAYLOAD_NOACK, so
+* they go back-to-back without waiting for ACKs that would never come from a
+* group of receivers. Delivery is not confirmed. EN_DYN_ACK is enabled if
+* needed; receivers keep their configuration.
+*
+* @param size how many bytes to be written
+* @param buffer buffer containing data to be written
+*
+* @return how many bytes left the module
+*/
+int NRFController::broadcastData(int size, const char* buffer) {
+    if (!setDynamicAck(true)) {
+        return 0;
+    }
+
+    return transmitData(size, buffer, true);
+}
+
+/**
+* @brief Send a single package without asking for an acknowledgement
+* Blocks only until the package left the module. EN_DYN_ACK is enabled if
+* needed.
+*
+* @param data buffer containing data
+* @param size package size, see sendPkg()
+*
+* @return true if the package was sent, false otherwise
+*/
+bool NRFController::broadcastPkg(const char* data, int size) {
+    if (size < 0) {
+        size = txPayloadSize();
+    }
+
+    if (size == 0 || !setDynamicAck(true)) {
+        return false;
+    }
+
+    queuePayload(data, size, true);
+    if (!submitQueue() || !pulseTx()) {
+        return false;
+    }
+
+    return clearEvents(NRF_STATUS_TX_DS);
+}
+
+/**
+* @brief Enable or disable W_TX_PAYLOAD_NOACK, which lets single packages
+* skip the acknowledgement. Only the transmitter needs it.
+*
+* @param enable true to enable, false to disable
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setDynamicAck(bool enable) {
+    return setFields(nrfField<NRFReg::EN_DYN_ACK>(enable));
+}
+
+/**
+* @brief Payloads taken from a buffer, split in packages
+*/
+struct NRFBufferSource {
+    const char* buffer;
+    int size;
+    int offset;
+
+    bool done() const { return offset >= size; }
+    const char* data() const { return buffer + offset; }
+    int left() const { return size - offset; }
+    void advance(int queued) { offset += queued; }
+};
+
+/**
+* @brief Payloads taken from an array of packages, one each
+*/
+struct NRFPacketSource {
+    const NRFPacket* packets;
+    int count;
+    int index;
+
+    bool done() const { return index >= count; }
+    const char* data() const { return (const char*)packets[index].data; }
+    int left() const { return packets[index].size; }
+    void advance(int) { index++; }
+};
+
+/**
+* @brief Pipelined transmission behind writeData() and broadcastData()
+*
+* @param size how many bytes to be written
+* @param buffer buffer containing data to be written
+* @param noAck true to send packages without asking for acknowledgements
+*
+* @return how many bytes were effectively written
+*/
+int NRFController::transmitData(int size, const char* buffer, bool noAck) {
+    NRFBufferSource source = {buffer, size, 0};
+    int chunk = txPayloadSize();
+    int sent;
+
+    if (chunk == 0 || size <= 0) {
+        return 0;
+    }
+
+    //only the last package may be shorter than chunk
+    sent = transmitPayloads(source, noAck) * chunk;
+    return sent < size ? sent : size;
+}
+
+/**
+* @brief send several packages, each one with its own size, in a single
+* pipelined run like writeData(). Sizes are ignored unless pipe 0 uses dynamic
+* payload length. Module must be powered up and in TX mode.
+*
+* @param packets packages to send. Pipes are ignored
+* @param count number of packages
+*
+* @return how many packages, from the start of the array, were effectively
+* sent. Packages are only counted once the module confirms they left the FIFO
+*/
+int NRFController::writePackets(const NRFPacket packets[], int count) {
+    NRFPacketSource source = {packets, count, 0};
+
+    if (txPayloadSize() == 0 || count <= 0) {
+        return 0;
+    }
+
+    return transmitPayloads(source, false);
+}
+
+/**
+* @brief Keeps the TX FIFO full with CE high until every payload of source
+* left it, or the module gives up
+*
+* @param source where payloads come from
+* @param noAck true to send packages without asking for acknowledgements
+*
+* @return how many packages were effectively sent
+*/
+template<class Source>
+int NRFController::transmitPayloads(Source& source, bool noAck) {
+    int writeIds[NRF_TX_FIFO_DEPTH];
+    int writeSizes[NRF_TX_FIFO_DEPTH];
+    uint8_t pendingEvents = 0;
+    uint8_t regFifoStatus;
+    //FIFO occupancy, as of the last FIFO_STATUS read. It's only exact when
+    //the FIFO is empty or full, otherwise it holds one or two packages
+    int minInFlight = 0;
+    int maxInFlight = 0;
+    int loaded = 0;
+    int sent = 0;
+    int maxRtRetries = 0;
+    int fifoId;
+    uint64_t deadline;
+
+    setCE(true);
+    deadline = monotonicUs() + NRF_TX_TIMEOUT_MS * 1000;
+
+    while (true) {
+        Source cursor = source;
+        int writes = 0;
+        int progress = 0;
+        int lastSent = sent;
+
+        //refill FIFO, acknowledge events and check FIFO level in one go
+        if (pendingEvents) {
+            queueWriteRegister(NRF_REG_STATUS, &pendingEvents);
+            pendingEvents = 0;
+        }
+        //packages only leave the FIFO, so every free slot we know of is still
+        //free. At most one write goes beyond that, and being the last one, a
+        //rejection can't let a later package overtake it
+        while (!cursor.done() && writes < NRF_TX_FIFO_DEPTH - minInFlight) {
+            writeSizes[writes] = queuePayload(cursor.data(), cursor.left(), noAck);
+            writeIds[writes] = m_device->queuedTransacts() - 1;
+            cursor.advance(writeSizes[writes]);
+            writes++;
+        }
+        fifoId = queueReadRegister(NRF_REG_FIFO_STATUS);
+        if (!submitQueue()) {
+            break;
+        }
+
+        //STATUS clocked out with each write tells if the FIFO had room for it
+        for (int i=0;i<writes;i++) {
+            if (m_device->response(writeIds[i])[0] & NRF_STATUS_TX_FULL) {
+                break;
+            }
+            source.advance(writeSizes[i]);
+            loaded++;
+            progress++;
+        }
+
+        regFifoStatus = m_device->response(fifoId)[1];
+        if (regFifoStatus & NRF_FIFO_STATUS_TX_FULL) {
+            NRF_STATS(m_stats.txFifoFull++);
+            minInFlight = maxInFlight = NRF_TX_FIFO_DEPTH;
+        }
+        else if (regFifoStatus & NRF_FIFO_STATUS_TX_EMPTY) {
+            minInFlight = maxInFlight = 0;
+        }
+        else {
+            minInFlight = 1;
+            maxInFlight = NRF_TX_FIFO_DEPTH - 1;
+        }
+
+        //packages only leave the FIFO when acknowledged (or just sent, for
+        //noAck), in order
+        if (loaded - maxInFlight > sent) {
+            sent = loaded - maxInFlight;
+            progress += sent - lastSent;
+            //the limit applies to each head package
+            maxRtRetries = 0;
+        }
+
+        if (m_status & NRF_STATUS_TX_DS) {
+            pendingEvents |= NRF_STATUS_TX_DS;
+        }
+
+        if (m_status & NRF_STATUS_MAX_RT) {
+            NRF_STATS(m_stats.maxRtEvents++);
+            //head package is still in the FIFO. Clearing MAX_RT makes the
+            //module try it again, as CE is still high. The limit applies to
+            //each head package, the count restarts when one leaves the FIFO
+            if (++maxRtRetries > NRF_TX_MAX_RT_RETRIES) {
+                NRF_STATS(m_stats.txFailures++);
+                flushTx();
+                clearEvents(NRF_STATUS_MAX_RT | NRF_STATUS_TX_DS);
+                break;
+            }
+            pendingEvents |= NRF_STATUS_MAX_RT;
+            progress++;
+        }
+
+        if (source.done() && maxInFlight == 0) {
+            if (pendingEvents) {
+                clearEvents(pendingEvents);
+            }
+            break;
+        }
+
+        if (progress) {
+            deadline = monotonicUs() + NRF_TX_TIMEOUT_MS * 1000;
+        }
+        else if (monotonicUs() > deadline) {
+            //module is not transmitting at all. Give up
+            NRF_STATS(m_stats.txFailures++);
+            flushTx();
+            break;
+        }
+        else if (!pendingEvents && eventFd() >= 0) {
+            //nothing to do until the module tells us something happened
+            m_device->waitIRQ(NRF_TX_TIMEOUT_MS);
+        }
+    }
+
+    setCE(false);
+    NRF_STATS(m_stats.txPackets += sent);
+
+    return sent;
+}
+
+/**
+* @brief low level method to dispatch a single package
+* Package is loaded into TX FIFO and CE is pulsed. The method blocks until the
+* package is acknowledged or the module gives up. Module must be powered up
+* and in TX mode.
+*
+* @param data buffer containing data. It must have the size specified in setPackageSize()
+* @param size package size, when using dynamic payload length. Negative uses
+* the size specified in setPackageSize(), or the maximum size if pipe 0 uses
+* dynamic payload length
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::sendPkg(const char* data, int size) {
+    if (size < 0) {
+        size = txPayloadSize();
+    }
+
+    if (size == 0) {
+        return false;
+    }
+
+    queuePayload(data, size);
+    if (!submitQueue() || !pulseTx()) {
+        return false;
+    }
+
+    return clearEvents(NRF_STATUS_TX_DS);
+}
+
+/**
+* @brief dispatch a single package straight from a packet buffer, without
+* intermediate copies. Like sendPkg(), the method blocks until the package is
+* acknowledged or the module gives up. Module must be powered up and in TX mode.
+*
+* @param packet package to send. Pipe is ignored, size is only used with
+* dynamic payload length; otherwise the whole package size set with
+* setPacketSize() is sent as it is in the buffer. The command byte in front of
+* the payload is overwritten
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::sendPacket(NRFPacketBuffer& packet) {
+    int size = txPayloadSize();
+
+    if (dynamicPayload(0) && packet.size < size) {
+        size = packet.size;
+    }
+
+    if (size == 0) {
+        return false;
+    }
+
+    packet.frame[0] = NRF_W_TX_PAYLOAD;
+    m_device->queueInPlace(packet.frame, size+1);
+    if (!submitQueue() || !pulseTx()) {
+        return false;
+    }
+
+    return clearEvents(NRF_STATUS_TX_DS);
+}
+
+/**
+* @brief Start sending a single package without waiting for the outcome
+* Package is loaded into TX FIFO and CE is pulsed. Call completeSend() once
+* the IRQ pin fires (see eventFd()) or from time to time. Module must be
+* powered up and in TX mode.
+*
+* @param data buffer containing data
+* @param size package size, as in sendPkg()
+*
+* @return true if transmission started, false otherwise
+*/
+bool NRFController::startSend(const char* data, int size) {
+    if (size < 0) {
+        size = txPayloadSize();
+    }
+
+    if (size == 0) {
+        return false;
+    }
+
+    queuePayload(data, size);
+    if (!submitQueue() || !pulseCE()) {
+        NRF_STATS(m_stats.txFailures++);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+* @brief Find out how the package started by startSend() went, based on the
+* last STATUS seen (refreshed by waitForEvent() or refreshStatus()). Events
+* are acknowledged, and a failed package is flushed.
+*
+* @return 1 if the package was acknowledged, -1 if the module gave up, 0 if
+* it's still on its way
+*/
+int NRFController::completeSend() {
+    if (m_status & NRF_STATUS_MAX_RT) {
+        NRF_STATS(m_stats.maxRtEvents++);
+        NRF_STATS(m_stats.txFailures++);
+        cancelSend();
+        return -1;
+    }
+
+    if (m_status & NRF_STATUS_TX_DS) {
+        NRF_STATS(m_stats.txPackets++);
+        return clearEvents(NRF_STATUS_TX_DS) ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/**
+* @brief Give up on the package started by startSend()
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::cancelSend() {
+    return flushTx() && clearEvents(NRF_STATUS_MAX_RT | NRF_STATUS_TX_DS);
+}
+
+/**
+* @brief Enable or disable payloads attached to auto acknowledgements
+* Both sides must enable it, as well as dynamic payload length on the pipes
+* involved (pipe 0 on the transmitter). See setDynamicPayload().
+*
+* @param enable true to enable, false to disable
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setAckPayload(bool enable) {
+    return setFields(nrfField<NRFReg::EN_ACK_PAY>(enable));
+}
+
+/**
+* @brief Queue a reply to be sent with the next acknowledgement on a pipe
+* The reply goes back within the same Enhanced ShockBurst exchange, without
+* switching to TX mode. Up to NRF_TX_FIFO_DEPTH replies may be waiting at once.
+*
+* @param pipe which pipe the reply is for
+* @param data reply data
+* @param size reply size, from 1 to 32 bytes
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::writeAckPayload(uint8_t pipe, const uint8_t* data, uint8_t size) {
+    uint8_t tx[NRF_MAX_PAYLOAD_SIZE+1];
+    uint8_t rx[NRF_MAX_PAYLOAD_SIZE+1];
+
+    //validate input
+    if (pipe >= NRF_PIPE_COUNT || size == 0 || size > NRF_MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    tx[0] = NRF_W_ACK_PAYLOAD | pipe;
+    memcpy(tx+1, data, size);
+
+    if (!m_device->transact(tx, rx, size+1)) {
+        return false;
+    }
+
+    captureStatus(rx[0]);
+    return true;
+}
+
+/**
+* @brief Send a package and collect the payload attached to its acknowledgement
+* Module must be powered up and in TX mode, with ACK payloads enabled.
+*
+* @param data buffer containing data
+* @param size package size. Negative uses the size specified in setPackageSize()
+* @param reply pre-allocated buffer able to hold NRF_MAX_PAYLOAD_SIZE bytes
+*
+* @return reply size, 0 if package was acknowledged without payload, -1 on failure
+*/
+int NRFController::sendRequest(const char* data, int size, uint8_t* reply) {
+    uint8_t tx[NRF_MAX_PAYLOAD_SIZE+1];
+    uint8_t clearFlags = NRF_STATUS_TX_DS | NRF_STATUS_RX_DR;
+    const uint8_t* rx;
+    int widthId;
+    int payloadId;
+    int width;
+
+    if (size < 0) {
+        size = txPayloadSize();
+    }
+
+    if (size == 0) {
+        return -1;
+    }
+
+    queuePayload(data, size);
+    if (!submitQueue() || !pulseTx()) {
+        return -1;
+    }
+
+    //RX_DR comes together with TX_DS when the acknowledgement carried a payload
+    if (!(m_status & NRF_STATUS_RX_DR) && pendingPipe() < 0) {
+        return clearEvents(NRF_STATUS_TX_DS) ? 0 : -1;
+    }
+
+    //fetch width, payload and clear both events in a single submission
+    memset(tx, 0, sizeof(tx));
+    tx[0] = NRF_R_RX_PL_WID;
+    widthId = m_device->queueTransact(tx, 2);
+    tx[0] = NRF_R_RX_PAYLOAD;
+    payloadId = m_device->queueTransact(tx, NRF_MAX_PAYLOAD_SIZE+1);
+    queueWriteRegister(NRF_REG_STATUS, &clearFlags);
+
+    if (!submitQueue() || (rx = m_device->response(payloadId)) == NULL) {
+        return -1;
+    }
+
+    width = m_device->response(widthId)[1];
+    if (width > NRF_MAX_PAYLOAD_SIZE) {
+        discardRxPayloads();
+        return -1;
+    }
+
+    memcpy(reply, rx+1, width);
+    return width;
+}
+
+/**
+* @brief Start transmission of the package waiting in TX FIFO and wait until
+* it's acknowledged or the module gives up
+*
+* @return true if package was acknowledged, false otherwise
+*/
+bool NRFController::pulseTx() {
+    NRF_STATS(uint64_t start = nrfStatsNowNs());
+
+    //CE must stay high for at least 10us to start transmission
+    if (!pulseCE()) {
+        NRF_STATS(m_stats.txFailures++);
+        return false;
+    }
+
+    if (!waitTxEvent(NRF_TX_TIMEOUT_MS)) {
+        NRF_STATS(m_stats.txFailures++);
+        flushTx();
+        return false;
+    }
+
+    NRF_STATS(m_stats.txLatency.record(nrfStatsNowNs() - start));
+
+    if (m_status & NRF_STATUS_MAX_RT) {
+        NRF_STATS(m_stats.maxRtEvents++);
+        NRF_STATS(m_stats.txFailures++);
+        //failed package would block the FIFO
+        flushTx();
+        clearEvents(NRF_STATUS_MAX_RT | NRF_STATUS_TX_DS);
+        return false;
+    }
+
+    NRF_STATS(m_stats.txPackets++);
+    return true;
+}
+
+/**
+* @brief Queue a W_TX_PAYLOAD command holding one package
+*
+* @param data package data
+* @param size how many bytes are available in data. With fixed payload length
+* missing bytes are sent as zeros
+* @param noAck true to use W_TX_PAYLOAD_NOACK instead
+*
+* @return how many bytes of data were used
+*/
+int NRFController::queuePayload(const char* data, int size, bool noAck) {
+    uint8_t tx[NRF_MAX_PAYLOAD_SIZE+1];
+    int payloadSize = txPayloadSize();
+
+    if (size > payloadSize) {
+        size = payloadSize;
+    }
+
+    if (dynamicPayload(0)) {
+        payloadSize = size;
+    }
+
+    tx[0] = noAck ? NRF_W_TX_PAYLOAD_NOACK : NRF_W_TX_PAYLOAD;
+    memcpy(tx+1, data, size);
+    //only padding needs clearing
+    memset(tx+1+size, 0, payloadSize-size);
+    m_device->queueTransact(tx, payloadSize+1);
+
+    return size;
+}
+
+/**
+* @brief Largest package we may transmit
+*
+* @return pipe 0 package size, or NRF_MAX_PAYLOAD_SIZE when using dynamic payload length
+*/
+int NRFController::txPayloadSize() {
+    if (dynamicPayload(0)) {
+        return NRF_MAX_PAYLOAD_SIZE;
+    }
+    return m_packetSize[0];
+}
+
+/**
+* @brief Discard every package in the TX FIFO
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::flushTx() {
+    uint8_t tx = NRF_FLUSH_TX;
+    uint8_t rx;
+
+    if (!m_device->transact(&tx, &rx, 1)) {
+        return false;
+    }
+
+    captureStatus(rx);
+    return true;
+}
+
+/**
+* @brief Wait until the module reports TX_DS or MAX_RT
+* Uses the IRQ pin if available, polling STATUS otherwise.
+*
+* @param timeoutMs how long to wait, in milliseconds
+*
+* @return true if one of the events happened, false on timeout or error
+*/
+bool NRFController::waitTxEvent(int timeoutMs) {
+    uint64_t deadline = monotonicUs() + timeoutMs * 1000;
+
+    while (true) {
+        if (!refreshStatus()) {
+            return false;
+        }
+
+        if (m_status & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)) {
+            return true;
+        }
+
+        if (monotonicUs() > deadline) {
+            return false;
+        }
+
+        if (eventFd() >= 0) {
+            m_device->waitIRQ(timeoutMs);
+        }
+    }
+}
+
+/**
+* @brief check if there are any package available for reading
+*
+* @return true if there's anything to be read, false otherwise
+*/
+bool NRFController::dataAvailable() {
+    //only we drain the RX FIFO, so a pending payload seen before is still there
+    if (pendingPipe() >= 0) {
+        return true;
+    }
+
+    if (!refreshStatus()) {
+        return false;
+    }
+    return pendingPipe() >= 0;
+}
+
+/**
+* @brief Last STATUS register value seen
+* The module sends STATUS at the beginning of every command, so this is
+* updated by every method that talks to it, at no extra cost.
+*
+* @return last known STATUS value
+*/
+uint8_t NRFController::status() const {
+    return m_status;
+}
+
+/**
+* @brief Pipe of the payload at the head of the RX FIFO, from last known STATUS
+*
+* @return pipe number (0 to 5), or -1 if the RX FIFO was empty
+*/
+int NRFController::pendingPipe() const {
+    if ((m_status & NRF_STATUS_RX_P_NO_MASK) == NRF_STATUS_RX_P_NO_EMPTY) {
+        return -1;
+    }
+    return (m_status & NRF_STATUS_RX_P_NO_MASK) >> 1;
+}
+
+/**
+* @brief Tell if TX FIFO was full, from last known STATUS
+*
+* @return true if there was no room for another payload, false otherwise
+*/
+bool NRFController::txFull() const {
+    return m_status & NRF_STATUS_TX_FULL;
+}
+
+/**
+* @brief Fetch STATUS from the module using the cheapest possible command
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::refreshStatus() {
+    uint8_t tx = NRF_NOP;
+    uint8_t rx;
+
+    if (!m_device->transact(&tx, &rx, 1)) {
+        return false;
+    }
+
+    captureStatus(rx);
+    return true;
+}
+
+/**
+* @brief Record STATUS as clocked out by the module at the start of a command
+*
+* @param regStatus STATUS register value
+*/
+void NRFController::captureStatus(uint8_t regStatus) {
+    m_status = regStatus;
+}
+
+/**
+* @brief Read the module transmission quality counters
+*
+* @param lost packages lost since last channel change (PLOS_CNT, saturates at 15)
+* @param retransmits retransmissions needed by the last package (ARC_CNT)
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::readObserveTx(uint8_t& lost, uint8_t& retransmits) {
+    uint8_t regObserveTx;
+
+    if (!readRegister(NRF_REG_OBSERVE_TX, &regObserveTx)) {
+        return false;
+    }
+
+    lost = nrfFieldValue<NRFReg::PLOS_CNT>(regObserveTx);
+    retransmits = nrfFieldValue<NRFReg::ARC_CNT>(regObserveTx);
+    return true;
+}
+
+/**
+* @brief Restart the lost packages count (PLOS_CNT) of OBSERVE_TX
+* the module only does that when RF_CH is written, so the channel is written
+* again even though it did not change
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::resetLostPackets() {
+    uint8_t regRfCh;
+
+    if (!getRegister(NRF_REG_RF_CH, regRfCh)) {
+        return false;
+    }
+
+    return writeRegister(NRF_REG_RF_CH, &regRfCh);
+}
+
+/**
+* @brief Read the Received Power Detector (RPD, formerly CD)
+* only meaningful in RX mode. It latches when a signal stronger than -64dBm
+* is seen on the channel for at least 40us
+*
+* @param detected receives true if a strong signal was detected
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::readReceivedPower(bool& detected) {
+    uint8_t regCd;
+
+    if (!readRegister(NRF_REG_CD, &regCd)) {
+        return false;
+    }
+
+    detected = nrfFieldValue<NRFReg::RPD>(regCd);
     return true;
 }
 
+/**
+* @brief Take a snapshot of SPI, FIFO and link counters
+* Costs one SPI transaction, to read OBSERVE_TX. Everything is zero if the
+* library was built with NRF_DISABLE_STATS.
+*
+* @return counters since creation or last resetStats()
+*/
+NRFStats NRFController::stats() {
+    NRFStats snapshot = m_stats;
+
+    snapshot.transport = m_device->stats();
+    NRF_STATS(readObserveTx(snapshot.lostPackets, snapshot.retransmits));
+    return snapshot;
+}
+
+/**
+* @brief Zero every counter
+*/
+void NRFController::resetStats() {
+    m_stats.reset();
+    m_device->resetStats();
+}
+
+/**
+* @brief Use the module IRQ pin to wait for events, instead of polling
+*
+* @param gpioChip GPIO chip device the pin belongs to, like /dev/gpiochip0
+* @param line line offset of the IRQ pin inside the chip
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setIRQ(const char* gpioChip, int line) {
+    return m_device->openIRQ(gpioChip, line);
+}
+
+/**
+* @brief File descriptor that becomes readable when RX_DR, TX_DS or MAX_RT
+* fires. Use it with poll()/epoll in your own loop, then call waitForEvent()
+* with a zero timeout to find out what happened.
+*
+* @return the descriptor, or -1 if setIRQ() wasn't called
+*/
+int NRFController::eventFd() const {
+    return m_device->irqFd();
+}
+
+/**
+* @brief Block until the module signals an event on its IRQ pin
+* setIRQ() must be called before using this method. Events are not cleared;
+* readData() clears RX_DR, use clearEvents() for the others.
+*
+* @param timeoutMs how long to wait, in milliseconds. Negative waits forever
+*
+* @return a combination of NRF_STATUS_RX_DR, NRF_STATUS_TX_DS and
+* NRF_STATUS_MAX_RT, 0 on timeout or -1 on error
+*/
+int NRFController::waitForEvent(int timeoutMs) {
+    int ret;
+
+    ret = m_device->waitIRQ(timeoutMs);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    if (!refreshStatus()) {
+        return -1;
+    }
+
+    return m_status & NRF_STATUS_IRQ_MASK;
+}
+
+/**
+* @brief Acknowledge events, releasing the IRQ pin
+*
+* @param events combination of NRF_STATUS_RX_DR, NRF_STATUS_TX_DS and NRF_STATUS_MAX_RT
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::clearEvents(uint8_t events) {
+    events &= NRF_STATUS_IRQ_MASK;
+
+    return writeRegister(NRF_REG_STATUS, &events);
+}
+
+/**
+* @brief Activate ou deactivate de module power
+* Module must be activated before transmiting or receiving anything
+*
+* @param powerUp true to enable power, false to disable
+*
+* @return true for success, false otherwise
+*/
+bool NRFController::setPowerUp(bool powerUp) {
+    return setFields(nrfField<NRFReg::PWR_UP>(powerUp));
+}
+
+/**
+* @brief 
+*
+* @param mode
+*
+* @return 
+*/
+bool NRFController::setMode(NRFMode mode) {
+    switch (mode) {
+        case NRFTxMode:
+            setCE(false);
+            return setFields(nrfField<NRFReg::PRIM_RX>(0));
+
+        case NRFRxMode:
+            setCE(true);
+            return setFields(nrfField<NRFReg::PRIM_RX>(1));
+
+        default:
+            return false;
+    }
+}
+
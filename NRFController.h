@@ -20,53 +20,100 @@
 #define NRFCONTROLER_H
 
 #include "HWAbstraction.h"
+#include "NRFRegisters.h"
+#include "NRFPacketBuffer.h"
+#include <vector>
 
 #define NRF_MAX_ADDRESS_SIZE 5
-#define NRF_MAX_CHANNEL 127
+#define NRF_MAX_CHANNEL 125
+#define NRF_CHANNEL_COUNT (NRF_MAX_CHANNEL + 1)
+#define NRF_PIPE_COUNT 6
+#define NRF_RX_FIFO_DEPTH 3
+#define NRF_TX_FIFO_DEPTH 3
+#define NRF_CE_PULSE_US 15
+#define NRF_POWER_UP_US 1500
+#define NRF_TX_TIMEOUT_MS 100
+#define NRF_TX_MAX_RT_RETRIES 5
+#define NRF_RPD_SETTLE_US 170
+#define NRF_RX_SETTLE_US 130
+#define NRF_SCAN_BATCH 32
+#define NRF_SPI_AUTO_SPEED 0
+#define NRF_SPI_CALIBRATE_ROUNDS 4
 
 
 #define NRF_R_REGISTER 0x00
 #define NRF_W_REGISTER 0x20
 #define NRF_R_RX_PAYLOAD 0x61
+#define NRF_R_RX_PL_WID 0x60
 #define NRF_W_TX_PAYLOAD 0xA0
+#define NRF_W_ACK_PAYLOAD 0xA8
+#define NRF_W_TX_PAYLOAD_NOACK 0xB0
 #define NRF_FLUSH_TX 0xE1
 #define NRF_FLUXH_RX 0xE2
+#define NRF_FLUSH_RX NRF_FLUXH_RX
 #define NRF_REUSE_TX_PL 0xE3
 #define NRF_NOP 0xFF
 
 #define NRF_DUMMY 0x00
 
-#define NRF_REG_CONFIG 0x00
-#define NRF_REG_EN_AA 0x01
-#define NRF_REG_EN_RXADDR 0x02
-#define NRF_REG_SETUP_AW 0x03
-#define NRF_REG_SETUP_RETR 0x04
-#define NRF_REG_RF_CH 0x05
-#define NRF_REG_RF_SETUP 0x06
-#define NRF_REG_STATUS 0x07
-#define NRF_REG_OBSERVE_TX 0x08
-#define NRF_REG_CD 0x09
-#define NRF_REG_RX_ADDR_P0 0x0A
-#define NRF_REG_RX_ADDR_P1 0x0B
-#define NRF_REG_RX_ADDR_P2 0x0C
-#define NRF_REG_RX_ADDR_P3 0x0D
-#define NRF_REG_RX_ADDR_P4 0x0E
-#define NRF_REG_RX_ADDR_P5 0x0F
-#define NRF_REG_TX_ADDR 0x10
-#define NRF_REG_RX_PW_P0 0x11
-#define NRF_REG_RX_PW_P1 0x12
-#define NRF_REG_RX_PW_P2 0x13
-#define NRF_REG_RX_PW_P3 0x14
-#define NRF_REG_RX_PW_P4 0x15
-#define NRF_REG_RX_PW_P5 0x16
-#define NRF_REG_FIFO_STATUS 0x017
+#define NRF_FEATURE_EN_DPL 0x04
+#define NRF_FEATURE_EN_ACK_PAY 0x02
+#define NRF_FEATURE_EN_DYN_ACK 0x01
 
+#define NRF_STATUS_RX_DR 0x40
+#define NRF_STATUS_TX_DS 0x20
+#define NRF_STATUS_MAX_RT 0x10
+#define NRF_STATUS_IRQ_MASK (NRF_STATUS_RX_DR | NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)
+#define NRF_STATUS_RX_P_NO_MASK 0x0E
+#define NRF_STATUS_RX_P_NO_EMPTY 0x0E
+#define NRF_STATUS_TX_FULL 0x01
+
+#define NRF_FIFO_STATUS_TX_FULL 0x20
+#define NRF_FIFO_STATUS_TX_EMPTY 0x10
+#define NRF_FIFO_STATUS_RX_FULL 0x02
+#define NRF_FIFO_STATUS_RX_EMPTY 0x01
+
+
+struct NRFPacket {
+    uint8_t pipe;
+    uint8_t size;
+    uint8_t data[NRF_MAX_PAYLOAD_SIZE];
+};
+
+/**
+* @brief Occupancy of every channel, as seen by scanChannels()
+*/
+struct NRFChannelMap {
+    int passes;
+    uint16_t busy[NRF_CHANNEL_COUNT];
+
+    int quietest(int first = 0, int last = NRF_CHANNEL_COUNT - 1) const {
+        int best = first;
+
+        for (int i=first;i<=last && i<NRF_CHANNEL_COUNT;i++) {
+            if (busy[i] < busy[best]) {
+                best = i;
+            }
+        }
+        return best;
+    }
+};
+
+struct NRFConfig;
 
 class NRFController {
     public:
     enum NRFDataRate {
         NRF1Mbps,
-        NRF2Mbps
+        NRF2Mbps,
+        NRF250kbps
+    };
+
+    enum NRFPowerLevel {
+        NRFPowerMinus18dBm,
+        NRFPowerMinus12dBm,
+        NRFPowerMinus6dBm,
+        NRFPower0dBm
     };
 
     enum NRFMode {
@@ -74,30 +121,162 @@ class NRFController {
         NRFRxMode
     };
 
-    NRFController(const char* dev);
+    NRFController(const char* dev, uint32_t spiSpeed = NRF_SPI_DEFAULT_SPEED,
+            const char* gpioChip = HW_GPIO_CHIP, int ceLine = HW_CE_LINE);
+    NRFController(NRFTransport* transport);
     ~NRFController();
 
+    bool setSpiSpeed(uint32_t hz);
+    uint32_t spiSpeed() const;
+    uint32_t calibrateSpiSpeed(uint32_t maxHz = NRF_SPI_MAX_SPEED);
+    template<class... Fields>
+    bool setFields(NRFFieldValue<Fields>... values);
+    template<class Field>
+    bool getField(uint8_t& value);
     bool setPacketSize(uint8_t numBytes, uint8_t pipe = 0);
     bool setCRC(int size);
     bool setDataRate(NRFDataRate rate);
+    bool setPowerLevel(NRFPowerLevel level);
     bool setRetries(int retries);
+    bool setRetransmitDelay(int delayUs);
     bool setAutoAck(bool autoAck, uint8_t pipe = 0);
     bool setAddressWidth(int width);
     uint8_t addressWidth();
     bool setRxAddress(uint64_t address, uint8_t n, uint8_t pipe = 0);
+    bool setPipeEnabled(bool enable, uint8_t pipe);
     bool setChannel(int channel);
-    int readData(uint8_t* buffer);
+    bool hopChannel(int channel);
+    bool scanChannels(NRFChannelMap& map, int passes = 1);
+    int readData(uint8_t* buffer, uint8_t* pipe = NULL);
+    int readPacket(NRFPacketBuffer& packet);
+    int readBurst(NRFPacket packets[], int maxPackets);
+    int readBurst(NRFPacketBuffer* packets[], int maxPackets);
     int writeData(int size, const char* buffer);
-    bool sendPkg(const char* data);
+    int writePackets(const NRFPacket packets[], int count);
+    bool sendPkg(const char* data, int size = -1);
+    bool sendPacket(NRFPacketBuffer& packet);
+    bool startSend(const char* data, int size = -1);
+    int completeSend();
+    bool cancelSend();
+    int broadcastData(int size, const char* buffer);
+    bool broadcastPkg(const char* data, int size = -1);
+    bool setDynamicAck(bool enable);
+    bool setDynamicPayload(bool enable, uint8_t pipe = 0);
+    bool dynamicPayload(uint8_t pipe);
+    bool setAckPayload(bool enable);
+    bool writeAckPayload(uint8_t pipe, const uint8_t* data, uint8_t size);
+    int sendRequest(const char* data, int size, uint8_t* reply);
     bool dataAvailable();
+    uint8_t status() const;
+    int pendingPipe() const;
+    bool txFull() const;
+    bool refreshStatus();
     bool setPowerUp(bool powerUp);
     bool setMode(NRFMode mode);
+    bool setIRQ(const char* gpioChip, int line);
+    int eventFd() const;
+    int waitForEvent(int timeoutMs = -1);
+    bool clearEvents(uint8_t events);
+    bool readObserveTx(uint8_t& lost, uint8_t& retransmits);
+    bool resetLostPackets();
+    bool readReceivedPower(bool& detected);
+    NRFStats stats();
+    void resetStats();
+    bool syncRegisters();
+    bool applyConfig(const NRFConfig& config);
+    int warmStart(const NRFConfig& config);
+    void invalidateRegister(uint8_t regNumber);
+    void invalidateRegisters();
     private:
     bool readRegister(uint8_t regNumber, uint8_t regBuffer[], int size = 1);
     bool writeRegister(uint8_t regNumber, const uint8_t regValue[], int size = 1);
+    bool getRegister(uint8_t regNumber, uint8_t& value);
+    bool updateRegister(uint8_t regNumber, uint8_t value);
+    bool updateBits(uint8_t regNumber, uint8_t mask, uint8_t bits);
+    static bool isVolatileRegister(uint8_t regNumber);
+    static int registerSize(uint8_t regNumber);
+    bool shadowMatches(uint8_t regNumber, uint8_t value);
+    bool shadowMatches(uint8_t regNumber, const uint8_t value[], int size);
+    int queueReadRegister(uint8_t regNumber, int size = 1);
+    int queueWriteRegister(uint8_t regNumber, const uint8_t regValue[], int size = 1, int delayUs = 0);
+    bool submitQueue();
+    void discardQueue();
+    int queueConfig(const NRFConfig& config);
+    bool verifySpi();
+    void init();
+    bool setCE(bool high);
+    bool pulseCE();
+    void queueRetune(uint8_t regConfig, uint8_t channel, int settleUs);
+    void captureStatus(uint8_t regStatus);
+    int queuePayload(const char* data, int size, bool noAck = false);
+    int transmitData(int size, const char* buffer, bool noAck);
+    template<class Source>
+    int transmitPayloads(Source& source, bool noAck);
+    int txPayloadSize();
+    int rxPayloadSize(int pipe);
+    bool discardRxPayloads();
+    bool flushTx();
+    bool waitTxEvent(int timeoutMs);
+    bool pulseTx();
+
+    struct QueuedRegister {
+        int transactId;
+        uint8_t regNumber;
+        uint8_t size;
+        bool write;
+        uint8_t value[NRF_MAX_ADDRESS_SIZE];
+    };
 
-    uint8_t m_packetSize;
-    HWAbstraction* m_device;
+    uint8_t m_packetSize[NRF_PIPE_COUNT];
+    uint8_t m_status;
+    uint8_t m_shadow[NRF_REG_COUNT][NRF_MAX_ADDRESS_SIZE];
+    uint32_t m_shadowValid;
+    bool m_ce;
+    std::vector<QueuedRegister> m_queuedRegisters;
+    NRFStats m_stats;
+    NRFTransport* m_device;
+    bool m_ownsDevice;
 };
 
+/**
+* @brief Change several fields of the same register with a single masked
+* write, skipped if the chip already holds the result. Register, mask and
+* access checks are resolved at compile time.
+*
+* Example: setFields(nrfField<NRFReg::PWR_UP>(1), nrfField<NRFReg::PRIM_RX>(1))
+*
+* @param values new field values, built with nrfField()
+*
+* @return true for success, false otherwise
+*/
+template<class... Fields>
+bool NRFController::setFields(NRFFieldValue<Fields>... values) {
+    typedef NRFFieldSet<Fields...> Set;
+
+    static_assert(Set::sameRegister, "fields must belong to the same register");
+    static_assert(!Set::overlapping, "fields must not overlap");
+    static_assert(Set::writable, "fields must be read/write");
+
+    return updateBits(Set::reg, Set::mask, nrfFieldBits(values...));
+}
+
+/**
+* @brief Retrieve a field value, using the shadow copy when possible
+*
+* @param value where the field value, shifted down to bit 0, will be stored
+*
+* @return true for success, false otherwise
+*/
+template<class Field>
+bool NRFController::getField(uint8_t& value) {
+    uint8_t regValue;
+
+    if (!getRegister(Field::reg, regValue)) {
+        return false;
+    }
+
+    value = nrfFieldValue<Field>(regValue);
+    return true;
+}
+
 #endif
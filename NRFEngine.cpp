@@ -0,0 +1,256 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFEngine.h"
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+
+/**
+* @brief instantiate an engine for a controller. The controller must be
+* already configured and powered up, and it's not owned by the engine.
+*
+* @param controller controller to drive
+*/
+NRFEngine::NRFEngine(NRFController* controller) {
+    m_controller = controller;
+    m_running = false;
+    m_droppedPackets = 0;
+    m_failedPackets = 0;
+    m_rxEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_txEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+/**
+* @brief stops the I/O thread and releases resources used by the engine
+*/
+NRFEngine::~NRFEngine() {
+    stop();
+    if (m_rxEventFd >= 0) {
+        close(m_rxEventFd);
+    }
+    if (m_txEventFd >= 0) {
+        close(m_txEventFd);
+    }
+}
+
+/**
+* @brief Put the radio in RX mode and start the I/O thread
+*
+* @param cpu CPU to pin the I/O thread to, or -1 to let the scheduler choose
+*
+* @return true for success, false otherwise
+*/
+bool NRFEngine::start(int cpu) {
+    if (m_running || m_rxEventFd < 0 || m_txEventFd < 0) {
+        return false;
+    }
+
+    if (!m_controller->setMode(NRFController::NRFRxMode)) {
+        return false;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&NRFEngine::run, this);
+
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        //not fatal, the thread just stays unpinned
+        pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus);
+    }
+    return true;
+}
+
+/**
+* @brief Stop the I/O thread. Packages still in the rings are kept.
+*/
+void NRFEngine::stop() {
+    if (!m_running) {
+        return;
+    }
+
+    m_running = false;
+    signal(m_txEventFd);
+    m_thread.join();
+}
+
+/**
+* @brief Tell if the I/O thread is running
+*
+* @return true if running, false otherwise
+*/
+bool NRFEngine::running() const {
+    return m_running;
+}
+
+/**
+* @brief Queue a package for transmission. Only one thread may call this.
+*
+* @param packet package to send. Pipe is ignored
+*
+* @return true for success, false if the TX ring is full
+*/
+bool NRFEngine::send(const NRFPacket& packet) {
+    if (!m_txRing.push(packet)) {
+        return false;
+    }
+
+    signal(m_txEventFd);
+    return true;
+}
+
+/**
+* @brief Get the oldest received package. Only one thread may call this.
+*
+* @param packet where the package will be stored
+*
+* @return true if a package was retrieved, false if there's none
+*/
+bool NRFEngine::receive(NRFPacket& packet) {
+    if (m_rxRing.pop(packet)) {
+        return true;
+    }
+
+    //reset the wakeup and look again, so a package pushed meanwhile is
+    //either seen now or leaves the descriptor readable
+    drain(m_rxEventFd);
+    return m_rxRing.pop(packet);
+}
+
+/**
+* @brief File descriptor that becomes readable when received packages are
+* waiting. Use it with poll()/epoll, then call receive() until it returns false.
+*
+* @return the descriptor
+*/
+int NRFEngine::rxEventFd() const {
+    return m_rxEventFd;
+}
+
+/**
+* @brief How many packages are queued for transmission
+*
+* @return number of packages
+*/
+size_t NRFEngine::pendingPackets() const {
+    return m_txRing.size();
+}
+
+/**
+* @brief How many received packages were discarded because the RX ring was full
+*
+* @return number of packages
+*/
+uint64_t NRFEngine::droppedPackets() const {
+    return m_droppedPackets;
+}
+
+/**
+* @brief How many packages the radio failed to deliver
+*
+* @return number of packages
+*/
+uint64_t NRFEngine::failedPackets() const {
+    return m_failedPackets;
+}
+
+void NRFEngine::run() {
+    NRFPacket packets[NRF_RX_FIFO_DEPTH];
+    NRFPacket* packet;
+    int count;
+
+    while (m_running) {
+        bool busy = false;
+
+        if (!m_txRing.empty()) {
+            m_controller->setMode(NRFController::NRFTxMode);
+            while ((packet = m_txRing.front()) != NULL) {
+                if (!m_controller->sendPkg((const char*)packet->data, packet->size)) {
+                    m_failedPackets++;
+                }
+                m_txRing.release();
+            }
+            m_controller->setMode(NRFController::NRFRxMode);
+            busy = true;
+        }
+
+        count = m_controller->readBurst(packets, NRF_RX_FIFO_DEPTH);
+        for (int i=0;i<count;i++) {
+            if (!m_rxRing.push(packets[i])) {
+                m_droppedPackets++;
+            }
+        }
+        if (count > 0) {
+            signal(m_rxEventFd);
+            busy = true;
+        }
+
+        if (!busy) {
+            waitWork();
+        }
+    }
+}
+
+/**
+* @brief Sleep until the radio raises its IRQ pin or the application queues
+* something to send. Without IRQ pin the radio is polled every
+* NRF_ENGINE_POLL_US microseconds.
+*/
+void NRFEngine::waitWork() {
+    struct pollfd fds[2];
+    struct timespec timeout;
+    int nfds = 1;
+
+    fds[0].fd = m_txEventFd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    if (m_controller->eventFd() >= 0) {
+        fds[1].fd = m_controller->eventFd();
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        nfds = 2;
+        //the pin is level triggered. Don't sleep on a pending event
+        if (m_controller->waitForEvent(0) != 0) {
+            return;
+        }
+    }
+
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = NRF_ENGINE_POLL_US * 1000;
+    ppoll(fds, nfds, nfds == 2 ? NULL : &timeout, NULL);
+
+    drain(m_txEventFd);
+}
+
+void NRFEngine::signal(int fd) {
+    uint64_t one = 1;
+    ssize_t ret = write(fd, &one, sizeof(one));
+    (void)ret;
+}
+
+void NRFEngine::drain(int fd) {
+    uint64_t value;
+    ssize_t ret = read(fd, &value, sizeof(value));
+    (void)ret;
+}
@@ -0,0 +1,68 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_ENGINE_H
+#define NRF_ENGINE_H
+
+#include "NRFController.h"
+#include "NRFRing.h"
+#include <atomic>
+#include <thread>
+
+#define NRF_ENGINE_RING_SIZE 64
+#define NRF_ENGINE_POLL_US 100
+
+/**
+* @brief Runs a NRFController in its own thread, exchanging packages with the
+* application through lock free rings. While the engine is running, the
+* controller must not be used by anyone else.
+*/
+class NRFEngine {
+    public:
+    NRFEngine(NRFController* controller);
+    ~NRFEngine();
+
+    bool start(int cpu = -1);
+    void stop();
+    bool running() const;
+
+    bool send(const NRFPacket& packet);
+    bool receive(NRFPacket& packet);
+    int rxEventFd() const;
+    size_t pendingPackets() const;
+    uint64_t droppedPackets() const;
+    uint64_t failedPackets() const;
+
+    private:
+    void run();
+    void waitWork();
+    void signal(int fd);
+    void drain(int fd);
+
+    NRFController* m_controller;
+    NRFRing<NRFPacket, NRF_ENGINE_RING_SIZE> m_rxRing;
+    NRFRing<NRFPacket, NRF_ENGINE_RING_SIZE> m_txRing;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<uint64_t> m_droppedPackets;
+    std::atomic<uint64_t> m_failedPackets;
+    int m_rxEventFd;
+    int m_txEventFd;
+};
+
+#endif
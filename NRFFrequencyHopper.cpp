@@ -0,0 +1,266 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFFrequencyHopper.h"
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define NRF_HOP_POLL_US 100
+
+static uint64_t monotonicUs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+* @brief instantiate a hopper for a controller, which is not owned by it
+*
+* @param controller controller of one end of the link, already configured
+* @param seed seed of the hop sequence, must be the same on both ends
+*/
+NRFFrequencyHopper::NRFFrequencyHopper(NRFController* controller, uint32_t seed) {
+    m_controller = controller;
+    m_seed = seed;
+    m_count = 0;
+    m_dwellUs = NRF_HOP_DWELL_US;
+    m_hop = 0;
+    m_deadline = 0;
+    m_misses = NRF_HOP_RESYNC_MISSES;
+}
+
+/**
+* @brief Set the channels to hop through and build the hop sequence
+* Both ends must use the same list, in the same order, and the same seed.
+*
+* @param channels list of distinct channels, from 0 to NRF_CHANNEL_COUNT - 1
+* @param count how many channels in the list
+*
+* @return true for success, false otherwise
+*/
+bool NRFFrequencyHopper::setChannels(const uint8_t channels[], int count) {
+    uint32_t random = m_seed ? m_seed : 0x9E3779B9;
+
+    //validate input
+    if (count <= 0 || count > NRF_CHANNEL_COUNT) {
+        return false;
+    }
+    for (int i=0;i<count;i++) {
+        if (channels[i] >= NRF_CHANNEL_COUNT) {
+            return false;
+        }
+    }
+
+    memcpy(m_sequence, channels, count);
+    m_count = count;
+
+    //Fisher-Yates shuffle driven by xorshift32, so every platform agrees
+    for (int i=count-1;i>0;i--) {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        std::swap(m_sequence[i], m_sequence[random % (i + 1)]);
+    }
+    return true;
+}
+
+/**
+* @brief Configure how long the link stays on each channel
+* The transmitter sends at most one package per dwell time, so it must be
+* longer than a complete transmission, retries included.
+*
+* @param dwellUs dwell time, in microseconds
+*/
+void NRFFrequencyHopper::setDwell(int dwellUs) {
+    if (dwellUs > 0) {
+        m_dwellUs = dwellUs;
+    }
+}
+
+/**
+* @brief Tune to a position of the hop sequence and start hopping from there
+* A receiver starts waiting for the transmitter, without hopping.
+*
+* @param hop position in the hop sequence
+*
+* @return true for success, false otherwise
+*/
+bool NRFFrequencyHopper::start(uint32_t hop) {
+    if (m_count == 0) {
+        return false;
+    }
+
+    m_hop = hop;
+    m_misses = NRF_HOP_RESYNC_MISSES;
+    m_deadline = monotonicUs();
+    return m_controller->hopChannel(channel());
+}
+
+/**
+* @brief Send a package on the current channel, then hop
+* Waits for the next slot if the previous package was sent less than a
+* dwell time ago.
+*
+* @param data package contents
+* @param size package size, -1 to use the TX width set by setPacketSize()
+*
+* @return true if the package was delivered, false otherwise
+*/
+bool NRFFrequencyHopper::send(const char* data, int size) {
+    uint64_t now = monotonicUs();
+    bool delivered;
+
+    if (now < m_deadline) {
+        usleep(m_deadline - now);
+        now = m_deadline;
+    }
+    m_deadline = now + m_dwellUs;
+
+    delivered = m_controller->sendPkg(data, size);
+    if (delivered) {
+        m_misses = 0;
+    }
+    else if (m_misses < NRF_HOP_RESYNC_MISSES) {
+        m_misses++;
+    }
+
+    return advance() && delivered;
+}
+
+/**
+* @brief Wait for a package on the current channel, for at most one slot
+* Hops after a package arrives, or when the slot passes empty while the
+* link is still synchronized.
+*
+* @param buffer pre-allocated buffer able to hold a complete package
+* @param pipe if not NULL, receives the pipe number the package arrived on
+*
+* @return how many bytes were read, 0 if the slot passed empty or -1 on error
+*/
+int NRFFrequencyHopper::receive(uint8_t* buffer, uint8_t* pipe) {
+    uint64_t now;
+    int size;
+
+    if (m_count == 0) {
+        return -1;
+    }
+
+    for (;;) {
+        size = m_controller->readData(buffer, pipe);
+        now = monotonicUs();
+        if (size > 0) {
+            m_misses = 0;
+            //allow for jitter on the transmitter side before giving up on the next one
+            m_deadline = now + m_dwellUs + m_dwellUs / 2;
+            return advance() ? size : -1;
+        }
+
+        if (now >= m_deadline) {
+            break;
+        }
+
+        if (m_controller->eventFd() >= 0) {
+            if (m_controller->waitForEvent((m_deadline - now + 999) / 1000) < 0) {
+                return -1;
+            }
+        }
+        else {
+            usleep(NRF_HOP_POLL_US);
+        }
+    }
+
+    if (!synchronized()) {
+        //the transmitter visits this channel once per sequence round
+        m_deadline = now + (uint64_t)m_dwellUs * m_count;
+        return 0;
+    }
+
+    m_misses++;
+    m_deadline += m_dwellUs;
+    if (!synchronized()) {
+        m_deadline = now + (uint64_t)m_dwellUs * m_count;
+    }
+    return advance() ? 0 : -1;
+}
+
+/**
+* @return channel of the current position in the hop sequence
+*/
+int NRFFrequencyHopper::channel() const {
+    return m_count ? m_sequence[m_hop % m_count] : -1;
+}
+
+/**
+* @return current position in the hop sequence
+*/
+uint32_t NRFFrequencyHopper::hop() const {
+    return m_hop;
+}
+
+/**
+* @return false if the last NRF_HOP_RESYNC_MISSES slots had no traffic
+*/
+bool NRFFrequencyHopper::synchronized() const {
+    return m_misses < NRF_HOP_RESYNC_MISSES;
+}
+
+/**
+* @brief Choose the quietest channels of a survey, to be used as hop set
+* Ties go to the lower channel. The result is sorted, so it can be sent to
+* the other end as is.
+*
+* @param map survey made by NRFController::scanChannels()
+* @param channels receives the channels picked
+* @param count how many channels to pick
+*
+* @return how many channels were picked
+*/
+int NRFFrequencyHopper::pickChannels(const NRFChannelMap& map, uint8_t channels[], int count) {
+    uint8_t order[NRF_CHANNEL_COUNT];
+
+    if (count > NRF_CHANNEL_COUNT) {
+        count = NRF_CHANNEL_COUNT;
+    }
+    if (count <= 0) {
+        return 0;
+    }
+
+    for (int i=0;i<NRF_CHANNEL_COUNT;i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order, order + NRF_CHANNEL_COUNT, [&map](uint8_t a, uint8_t b) {
+        return map.busy[a] < map.busy[b];
+    });
+    std::sort(order, order + count);
+
+    memcpy(channels, order, count);
+    return count;
+}
+
+/**
+* @brief Move to the next position of the hop sequence
+*
+* @return true for success, false otherwise
+*/
+bool NRFFrequencyHopper::advance() {
+    m_hop++;
+    return m_controller->hopChannel(channel());
+}
@@ -0,0 +1,66 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_FREQUENCY_HOPPER_H
+#define NRF_FREQUENCY_HOPPER_H
+
+#include "NRFController.h"
+
+#define NRF_HOP_DWELL_US 4000
+#define NRF_HOP_RESYNC_MISSES 3
+
+/**
+* @brief Moves a link through a hop sequence shared by both ends. The sequence
+* is a permutation of a channel list, shuffled from a seed, so both sides only
+* need to agree on the list and the seed.
+*
+* The transmitter paces itself, sending at most one package per dwell time
+* and hopping after every package, delivered or not. The receiver hops after
+* every package received, or when a slot passes empty. After
+* NRF_HOP_RESYNC_MISSES empty slots in a row it stops hopping and waits on its
+* current channel until the transmitter comes by again.
+*/
+class NRFFrequencyHopper {
+    public:
+    NRFFrequencyHopper(NRFController* controller, uint32_t seed);
+
+    bool setChannels(const uint8_t channels[], int count);
+    void setDwell(int dwellUs);
+    bool start(uint32_t hop = 0);
+    bool send(const char* data, int size = -1);
+    int receive(uint8_t* buffer, uint8_t* pipe = NULL);
+    int channel() const;
+    uint32_t hop() const;
+    bool synchronized() const;
+
+    static int pickChannels(const NRFChannelMap& map, uint8_t channels[], int count);
+
+    private:
+    bool advance();
+
+    NRFController* m_controller;
+    uint32_t m_seed;
+    uint8_t m_sequence[NRF_CHANNEL_COUNT];
+    int m_count;
+    int m_dwellUs;
+    uint32_t m_hop;
+    uint64_t m_deadline;
+    int m_misses;
+};
+
+#endif
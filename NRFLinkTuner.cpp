@@ -0,0 +1,280 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFLinkTuner.h"
+
+static const NRFController::NRFDataRate s_rates[] = {
+    NRFController::NRF250kbps,
+    NRFController::NRF1Mbps,
+    NRFController::NRF2Mbps
+};
+
+/**
+* @brief instantiate a tuner for a controller. Nothing is changed on the
+* module until start() is called.
+*
+* @param controller controller of the transmitting side, not owned by the tuner
+* @param bounds limits for every setting the tuner adjusts
+*/
+NRFLinkTuner::NRFLinkTuner(NRFController* controller, const NRFLinkBounds& bounds) {
+    m_controller = controller;
+    m_bounds = bounds;
+    m_window = NRF_TUNER_WINDOW;
+    m_ackPayloadSize = 0;
+    m_rate = rateIndex(bounds.maxRate);
+    m_power = bounds.maxPower;
+    m_retries = bounds.maxRetries;
+    m_packets = 0;
+    m_arcSum = 0;
+    m_arcSamples = 0;
+    m_goodWindows = 0;
+    m_rpdSamples = 0;
+    m_rpdDetected = 0;
+}
+
+/**
+* @brief Start from the fastest allowed data rate at the highest allowed
+* power and retries, and restart the feedback counters
+*
+* @return true for success, false otherwise
+*/
+bool NRFLinkTuner::start() {
+    m_rate = rateIndex(m_bounds.maxRate);
+    m_power = m_bounds.maxPower;
+    m_retries = m_bounds.maxRetries;
+    m_packets = 0;
+    m_arcSum = 0;
+    m_arcSamples = 0;
+    m_goodWindows = 0;
+    m_rpdSamples = 0;
+    m_rpdDetected = 0;
+
+    return apply() && m_controller->resetLostPackets();
+}
+
+/**
+* @brief Configure how many packages are sent between two decisions
+* PLOS_CNT saturates at 15, so windows larger than that hide how bad a
+* link really is
+*
+* @param packets packages per window
+*/
+void NRFLinkTuner::setWindow(int packets) {
+    if (packets > 0) {
+        m_window = packets;
+    }
+}
+
+/**
+* @brief Tell the tuner the size of payloads the peer attaches to its ACKs
+* the retransmit delay is never tuned below what is needed to receive them
+*
+* @param size ACK payload size, 0 if ACK payloads are not used
+*/
+void NRFLinkTuner::setAckPayloadSize(int size) {
+    if (size >= 0 && size <= NRF_MAX_PAYLOAD_SIZE) {
+        m_ackPayloadSize = size;
+    }
+}
+
+/**
+* @brief Feed the tuner after packages were sent. Costs one SPI transaction
+* to read OBSERVE_TX and, at the end of a window, the writes of whatever
+* setting changed
+*
+* @param count how many packages were sent since the last call
+*
+* @return true for success, false otherwise
+*/
+bool NRFLinkTuner::packetsSent(int count) {
+    uint8_t lost;
+    uint8_t retransmits;
+
+    if (!m_controller->readObserveTx(lost, retransmits)) {
+        return false;
+    }
+
+    m_packets += count;
+    m_arcSum += retransmits;
+    m_arcSamples++;
+    if (m_packets < m_window) {
+        return true;
+    }
+
+    return evaluate(lost);
+}
+
+/**
+* @brief Sample RPD while listening to the peer, usually right after a package
+* from it arrived. A peer that is always above -64dBm lets the tuner lower
+* the PA level on clean links; without samples it never does.
+*
+* @return true for success, false otherwise
+*/
+bool NRFLinkTuner::sampleReceivedPower() {
+    bool detected;
+
+    if (!m_controller->readReceivedPower(detected)) {
+        return false;
+    }
+
+    m_rpdSamples++;
+    if (detected) {
+        m_rpdDetected++;
+    }
+    return true;
+}
+
+/**
+* @brief Decide the settings for the next window
+* bad windows first raise the power and then lower the data rate, while a
+* sequence of clean windows raises the data rate and then lowers the power.
+* Once the most robust settings still lose most packages, retries are cut
+* down so doomed packages stop wasting air time.
+*
+* @param lost packages lost during the window, from PLOS_CNT
+*
+* @return true for success, false otherwise
+*/
+bool NRFLinkTuner::evaluate(int lost) {
+    int minRate = rateIndex(m_bounds.minRate);
+    int maxRate = rateIndex(m_bounds.maxRate);
+
+    if (lost * 10 > m_packets || m_arcSum * 2 > m_arcSamples * m_retries) {
+        m_goodWindows = 0;
+        if (m_power < m_bounds.maxPower) {
+            m_power++;
+        }
+        else if (m_rate > minRate) {
+            m_rate--;
+        }
+    }
+    else if (lost == 0 && m_arcSum * 4 <= m_arcSamples) {
+        if (++m_goodWindows >= NRF_TUNER_GOOD_WINDOWS) {
+            m_goodWindows = 0;
+            if (m_rate < maxRate) {
+                m_rate++;
+            }
+            else if (m_power > m_bounds.minPower && m_rpdDetected * 2 > m_rpdSamples) {
+                m_power--;
+            }
+            m_rpdSamples = 0;
+            m_rpdDetected = 0;
+        }
+    }
+    else {
+        m_goodWindows = 0;
+    }
+
+    if (m_power == m_bounds.maxPower && m_rate == minRate && lost * 2 > m_packets) {
+        m_retries = m_bounds.minRetries;
+    }
+    else {
+        m_retries = m_bounds.maxRetries;
+    }
+
+    m_packets = 0;
+    m_arcSum = 0;
+    m_arcSamples = 0;
+
+    return apply() && m_controller->resetLostPackets();
+}
+
+/**
+* @brief Write the current settings to the module
+*
+* @return true for success, false otherwise
+*/
+bool NRFLinkTuner::apply() {
+    return m_controller->setDataRate(s_rates[m_rate]) &&
+        m_controller->setPowerLevel(static_cast<NRFController::NRFPowerLevel>(m_power)) &&
+        m_controller->setRetries(m_retries) &&
+        m_controller->setRetransmitDelay(retransmitDelay());
+}
+
+/**
+* @brief Position of a data rate in s_rates, from the most robust to the fastest
+*/
+int NRFLinkTuner::rateIndex(NRFController::NRFDataRate rate) {
+    switch (rate) {
+        case NRFController::NRF250kbps:
+            return 0;
+        case NRFController::NRF1Mbps:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+/**
+* @brief Shortest retransmit delay that still lets the ACK arrive, from the
+* nRF24L01+ datasheet ARD table
+*
+* @return delay in microseconds
+*/
+int NRFLinkTuner::minRetransmitDelay() const {
+    switch (s_rates[m_rate]) {
+        case NRFController::NRF2Mbps:
+            return m_ackPayloadSize > 15 ? 500 : 250;
+        case NRFController::NRF1Mbps:
+            return m_ackPayloadSize > 5 ? 500 : 250;
+        default:
+            //250kbps needs at least 500us even without ACK payloads
+            if (m_ackPayloadSize == 0) {
+                return 500;
+            }
+            return 750 + (m_ackPayloadSize - 1) / 8 * 250;
+    }
+}
+
+/**
+* @return data rate currently in use
+*/
+NRFController::NRFDataRate NRFLinkTuner::dataRate() const {
+    return s_rates[m_rate];
+}
+
+/**
+* @return PA level currently in use
+*/
+NRFController::NRFPowerLevel NRFLinkTuner::powerLevel() const {
+    return static_cast<NRFController::NRFPowerLevel>(m_power);
+}
+
+/**
+* @return retries currently in use
+*/
+int NRFLinkTuner::retries() const {
+    return m_retries;
+}
+
+/**
+* @return retransmit delay currently in use, in microseconds
+*/
+int NRFLinkTuner::retransmitDelay() const {
+    int delayUs = minRetransmitDelay();
+
+    if (delayUs < m_bounds.minDelayUs) {
+        delayUs = m_bounds.minDelayUs;
+    }
+    if (delayUs > m_bounds.maxDelayUs) {
+        delayUs = m_bounds.maxDelayUs;
+    }
+    //ARD has a 250us granularity
+    return (delayUs + 249) / 250 * 250;
+}
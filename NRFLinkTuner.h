@@ -0,0 +1,84 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_LINK_TUNER_H
+#define NRF_LINK_TUNER_H
+
+#include "NRFController.h"
+
+#define NRF_TUNER_WINDOW 15
+#define NRF_TUNER_GOOD_WINDOWS 3
+
+/**
+* @brief Limits the tuner must respect. Data rate changes must be mirrored
+* by the peer, so keep minRate equal to maxRate unless the application has
+* a way to tell the other side about them.
+*/
+struct NRFLinkBounds {
+    NRFController::NRFDataRate minRate;
+    NRFController::NRFDataRate maxRate;
+    NRFController::NRFPowerLevel minPower;
+    NRFController::NRFPowerLevel maxPower;
+    int minRetries;
+    int maxRetries;
+    int minDelayUs;
+    int maxDelayUs;
+};
+
+/**
+* @brief Adjusts data rate, retransmit delay, retries and PA level of a
+* transmitter from OBSERVE_TX and RPD feedback. The settings are only
+* touched through the controller setters, so unchanged values cost nothing.
+*/
+class NRFLinkTuner {
+    public:
+    NRFLinkTuner(NRFController* controller, const NRFLinkBounds& bounds);
+
+    bool start();
+    void setWindow(int packets);
+    void setAckPayloadSize(int size);
+    bool packetsSent(int count = 1);
+    bool sampleReceivedPower();
+
+    NRFController::NRFDataRate dataRate() const;
+    NRFController::NRFPowerLevel powerLevel() const;
+    int retries() const;
+    int retransmitDelay() const;
+
+    private:
+    bool evaluate(int lost);
+    bool apply();
+    static int rateIndex(NRFController::NRFDataRate rate);
+    int minRetransmitDelay() const;
+
+    NRFController* m_controller;
+    NRFLinkBounds m_bounds;
+    int m_window;
+    int m_ackPayloadSize;
+    int m_rate;
+    int m_power;
+    int m_retries;
+    int m_packets;
+    int m_arcSum;
+    int m_arcSamples;
+    int m_goodWindows;
+    int m_rpdSamples;
+    int m_rpdDetected;
+};
+
+#endif
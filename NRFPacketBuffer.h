@@ -0,0 +1,84 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_PACKET_BUFFER_H
+#define NRF_PACKET_BUFFER_H
+
+#include "NRFRing.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define NRF_MAX_PAYLOAD_SIZE 32
+
+/**
+* @brief Package laid out the way it goes over SPI: one byte for the command
+* (overwritten by STATUS as the module answers) right in front of the payload,
+* so transports read and write it in place, without copies. Buffers are cache
+* line aligned, so the ones handed to different threads never share a line.
+*/
+struct alignas(NRF_CACHE_LINE_SIZE) NRFPacketBuffer {
+    uint8_t frame[NRF_MAX_PAYLOAD_SIZE + 1];
+    uint8_t size;
+    uint8_t pipe;
+
+    uint8_t* data() { return frame + 1; }
+    const uint8_t* data() const { return frame + 1; }
+};
+
+/**
+* @brief Fixed set of NRFPacketBuffer, preallocated and recycled. One thread
+* may acquire buffers while another releases them (e.g. the I/O thread fills
+* them and the application gives them back). The pool keeps the buffers'
+* alignment, so it must not be allocated with plain new before C++17.
+*
+* @tparam Size number of buffers. Must be a power of 2
+*/
+template <size_t Size>
+class NRFPacketPool {
+    public:
+    NRFPacketPool() {
+        static_assert(Size >= 1 && (Size & (Size - 1)) == 0, "pool size must be a power of 2");
+        for (size_t i=0;i<Size;i++) {
+            m_free.push(&m_buffers[i]);
+        }
+    }
+
+    /**
+    * @brief Take a buffer. Contents are whatever the last user left.
+    *
+    * @return the buffer, or NULL if every buffer is in use
+    */
+    NRFPacketBuffer* acquire() {
+        NRFPacketBuffer* buffer;
+        return m_free.pop(buffer) ? buffer : NULL;
+    }
+
+    /**
+    * @brief Give back a buffer taken with acquire()
+    */
+    void release(NRFPacketBuffer* buffer) {
+        m_free.push(buffer);
+    }
+
+    private:
+    NRFPacketBuffer m_buffers[Size];
+    //twice as big, as the ring keeps a slot free
+    NRFRing<NRFPacketBuffer*, Size * 2> m_free;
+};
+
+#endif
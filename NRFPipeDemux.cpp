@@ -0,0 +1,137 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFPipeDemux.h"
+
+/**
+* @brief instantiate a demultiplexer
+*
+* @param controller controller polled by poll(). May be NULL when packages
+* only come through deliver()
+*/
+NRFPipeDemux::NRFPipeDemux(NRFController* controller) {
+    m_controller = controller;
+    for (int i=0;i<NRF_PIPE_COUNT;i++) {
+        m_receivedPackets[i] = 0;
+        m_droppedPackets[i] = 0;
+    }
+}
+
+/**
+* @brief Set the handler called for every package arriving on a pipe. Pipes
+* without a handler keep their packages queued until receive() is called.
+* Must not be called while packages are being delivered.
+*
+* @param pipe pipe to handle
+* @param handler function to call, or an empty one to go back to queueing
+*
+* @return true for success, false otherwise
+*/
+bool NRFPipeDemux::setHandler(uint8_t pipe, Handler handler) {
+    if (pipe >= NRF_PIPE_COUNT) {
+        return false;
+    }
+
+    m_handlers[pipe] = handler;
+    return true;
+}
+
+/**
+* @brief Read every package waiting in the controller RX FIFO and route them
+*
+* @return number of packages read, or -1 on error
+*/
+int NRFPipeDemux::poll() {
+    NRFPacket packets[NRF_RX_FIFO_DEPTH];
+    int count;
+
+    if (!m_controller) {
+        return -1;
+    }
+
+    count = m_controller->readBurst(packets, NRF_RX_FIFO_DEPTH);
+    for (int i=0;i<count;i++) {
+        deliver(packets[i]);
+    }
+
+    return count;
+}
+
+/**
+* @brief Route a package to the handler or queue of its pipe
+*
+* @param packet package to route
+*
+* @return true for success, false if the pipe is invalid or its queue is full
+*/
+bool NRFPipeDemux::deliver(const NRFPacket& packet) {
+    uint8_t pipe = packet.pipe;
+
+    if (pipe >= NRF_PIPE_COUNT) {
+        return false;
+    }
+
+    if (m_handlers[pipe]) {
+        m_handlers[pipe](packet);
+    }
+    else if (!m_queues[pipe].push(packet)) {
+        m_droppedPackets[pipe]++;
+        return false;
+    }
+
+    m_receivedPackets[pipe]++;
+    return true;
+}
+
+/**
+* @brief Take the oldest package queued for a pipe
+*
+* @param pipe pipe to read
+* @param packet receives the package
+*
+* @return true for success, false if there's nothing queued
+*/
+bool NRFPipeDemux::receive(uint8_t pipe, NRFPacket& packet) {
+    if (pipe >= NRF_PIPE_COUNT) {
+        return false;
+    }
+
+    return m_queues[pipe].pop(packet);
+}
+
+/**
+* @brief Get how many packages were routed to a pipe
+*
+* @param pipe pipe to query
+*
+* @return number of packages
+*/
+uint64_t NRFPipeDemux::receivedPackets(uint8_t pipe) const {
+    return pipe < NRF_PIPE_COUNT ? m_receivedPackets[pipe] : 0;
+}
+
+/**
+* @brief Get how many packages were lost because the pipe queue was full
+*
+* @param pipe pipe to query
+*
+* @return number of packages
+*/
+uint64_t NRFPipeDemux::droppedPackets(uint8_t pipe) const {
+    return pipe < NRF_PIPE_COUNT ? m_droppedPackets[pipe] : 0;
+}
@@ -0,0 +1,57 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_PIPE_DEMUX_H
+#define NRF_PIPE_DEMUX_H
+
+#include "NRFController.h"
+#include "NRFRing.h"
+#include <functional>
+#include <stdint.h>
+
+#define NRF_DEMUX_QUEUE_SIZE 64
+
+/**
+* @brief Routes received packages to a per pipe handler or queue, keyed by the
+* pipe number the radio reported (RX_P_NO). Packages can be pulled straight
+* from a controller with poll(), or fed from elsewhere (e.g. a NRFEngine)
+* with deliver(). Handlers run in the thread delivering the packages; each
+* queue has one producer (the delivering thread) and one consumer.
+*/
+class NRFPipeDemux {
+    public:
+    typedef std::function<void(const NRFPacket&)> Handler;
+
+    NRFPipeDemux(NRFController* controller = NULL);
+
+    bool setHandler(uint8_t pipe, Handler handler);
+    int poll();
+    bool deliver(const NRFPacket& packet);
+    bool receive(uint8_t pipe, NRFPacket& packet);
+    uint64_t receivedPackets(uint8_t pipe) const;
+    uint64_t droppedPackets(uint8_t pipe) const;
+
+    private:
+    NRFController* m_controller;
+    Handler m_handlers[NRF_PIPE_COUNT];
+    NRFRing<NRFPacket, NRF_DEMUX_QUEUE_SIZE> m_queues[NRF_PIPE_COUNT];
+    uint64_t m_receivedPackets[NRF_PIPE_COUNT];
+    uint64_t m_droppedPackets[NRF_PIPE_COUNT];
+};
+
+#endif
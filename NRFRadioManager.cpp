@@ -0,0 +1,303 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFRadioManager.h"
+#include <new>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+//engine rings are cache line aligned, which plain new doesn't honor before C++17
+static NRFEngine* newEngine(NRFController* controller) {
+    void* memory;
+
+    if (posix_memalign(&memory, alignof(NRFEngine), sizeof(NRFEngine)) != 0) {
+        return NULL;
+    }
+    return new (memory) NRFEngine(controller);
+}
+
+static void deleteEngine(NRFEngine* engine) {
+    engine->~NRFEngine();
+    free(engine);
+}
+
+/**
+* @brief instantiate a manager without radios
+*/
+NRFRadioManager::NRFRadioManager() {
+    m_radioCount = 0;
+    m_nextTx = 0;
+    m_nextRx = 0;
+    m_running = false;
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+/**
+* @brief stops every radio and releases resources used by the manager.
+* Controllers are not owned by the manager and are left alone.
+*/
+NRFRadioManager::~NRFRadioManager() {
+    stop();
+    for (int i=0;i<m_radioCount;i++) {
+        deleteEngine(m_engines[i]);
+    }
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+    }
+}
+
+/**
+* @brief Add a radio. The controller must be already configured and powered
+* up, and must not be used by anyone else while the manager is running.
+*
+* @param controller controller to drive
+* @param cpu CPU to pin the radio thread to, or -1 to let the scheduler choose
+*
+* @return index of the radio for success, -1 otherwise
+*/
+int NRFRadioManager::addRadio(NRFController* controller, int cpu) {
+    struct epoll_event event;
+    NRFEngine* engine;
+
+    if (m_running || m_epollFd < 0 || m_radioCount == NRF_MANAGER_MAX_RADIOS) {
+        return -1;
+    }
+
+    engine = newEngine(controller);
+    if (!engine) {
+        return -1;
+    }
+    event.events = EPOLLIN;
+    event.data.u32 = m_radioCount;
+    if (engine->rxEventFd() < 0 || epoll_ctl(m_epollFd, EPOLL_CTL_ADD, engine->rxEventFd(), &event) < 0) {
+        deleteEngine(engine);
+        return -1;
+    }
+
+    m_engines[m_radioCount] = engine;
+    m_cpus[m_radioCount] = cpu;
+    return m_radioCount++;
+}
+
+/**
+* @brief Get how many radios were added
+*
+* @return number of radios
+*/
+int NRFRadioManager::radioCount() const {
+    return m_radioCount;
+}
+
+/**
+* @brief Get the engine driving a radio, to query its counters
+*
+* @param radio index returned by addRadio()
+*
+* @return the engine, or NULL if the index is invalid
+*/
+NRFEngine* NRFRadioManager::engine(int radio) {
+    if (radio < 0 || radio >= m_radioCount) {
+        return NULL;
+    }
+    return m_engines[radio];
+}
+
+/**
+* @brief Start the threads of every radio
+*
+* @return true for success, false otherwise. On failure no radio is left running
+*/
+bool NRFRadioManager::start() {
+    if (m_running || m_radioCount == 0) {
+        return false;
+    }
+
+    for (int i=0;i<m_radioCount;i++) {
+        if (!m_engines[i]->start(m_cpus[i])) {
+            for (int j=0;j<i;j++) {
+                m_engines[j]->stop();
+            }
+            return false;
+        }
+    }
+
+    m_running = true;
+    return true;
+}
+
+/**
+* @brief Stop the threads of every radio. Packages still queued are kept.
+*/
+void NRFRadioManager::stop() {
+    if (!m_running) {
+        return;
+    }
+
+    for (int i=0;i<m_radioCount;i++) {
+        m_engines[i]->stop();
+    }
+    m_running = false;
+}
+
+/**
+* @brief Tell if the radios are running
+*
+* @return true if running, false otherwise
+*/
+bool NRFRadioManager::running() const {
+    return m_running;
+}
+
+/**
+* @brief Queue a package on the radio with the fewest packages waiting to be
+* sent. Ties are broken round robin. Only one thread may send packages.
+*
+* @param packet package to send. Pipe is ignored
+*
+* @return index of the radio used for success, -1 if every radio is full
+*/
+int NRFRadioManager::send(const NRFPacket& packet) {
+    int best = -1;
+    size_t bestPending = 0;
+
+    for (int i=0;i<m_radioCount;i++) {
+        int radio = (m_nextTx + i) % m_radioCount;
+        size_t pending = m_engines[radio]->pendingPackets();
+
+        if (best < 0 || pending < bestPending) {
+            best = radio;
+            bestPending = pending;
+        }
+    }
+
+    if (best < 0) {
+        return -1;
+    }
+    m_nextTx = (best + 1) % m_radioCount;
+
+    if (m_engines[best]->send(packet)) {
+        return best;
+    }
+
+    //the pick was only a hint, try everyone else before giving up
+    for (int i=1;i<m_radioCount;i++) {
+        int radio = (best + i) % m_radioCount;
+        if (m_engines[radio]->send(packet)) {
+            return radio;
+        }
+    }
+    return -1;
+}
+
+/**
+* @brief Queue a package on a given radio. Only one thread may send packages.
+*
+* @param radio index returned by addRadio()
+* @param packet package to send. Pipe is ignored
+*
+* @return true for success, false if the index is invalid or the radio is full
+*/
+bool NRFRadioManager::send(int radio, const NRFPacket& packet) {
+    if (radio < 0 || radio >= m_radioCount) {
+        return false;
+    }
+    return m_engines[radio]->send(packet);
+}
+
+/**
+* @brief Get a received package from any radio. Radios are visited round
+* robin, so a busy one can't starve the others. Only one thread may receive
+* packages.
+*
+* @param packet where the package will be stored
+* @param radio if not NULL, receives the index of the radio the package came from
+*
+* @return true if a package was retrieved, false if there's none
+*/
+bool NRFRadioManager::receive(NRFPacket& packet, int* radio) {
+    for (int i=0;i<m_radioCount;i++) {
+        int current = (m_nextRx + i) % m_radioCount;
+
+        if (m_engines[current]->receive(packet)) {
+            m_nextRx = (current + 1) % m_radioCount;
+            if (radio) {
+                *radio = current;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+* @brief File descriptor that becomes readable when any radio has received
+* packages waiting. Use it with poll()/epoll, then call receive() until it
+* returns false.
+*
+* @return the descriptor
+*/
+int NRFRadioManager::rxEventFd() const {
+    return m_epollFd;
+}
+
+/**
+* @brief Wait until any radio has received packages waiting
+*
+* @param timeoutMs how long to wait, in milliseconds. -1 waits forever
+*
+* @return 1 if packages are waiting, 0 on timeout, -1 on error
+*/
+int NRFRadioManager::wait(int timeoutMs) {
+    struct epoll_event events[NRF_MANAGER_MAX_RADIOS];
+    int ret = epoll_wait(m_epollFd, events, NRF_MANAGER_MAX_RADIOS, timeoutMs);
+
+    if (ret < 0) {
+        return -1;
+    }
+    return ret > 0 ? 1 : 0;
+}
+
+/**
+* @brief How many received packages were discarded, summed over every radio
+*
+* @return number of packages
+*/
+uint64_t NRFRadioManager::droppedPackets() const {
+    uint64_t total = 0;
+
+    for (int i=0;i<m_radioCount;i++) {
+        total += m_engines[i]->droppedPackets();
+    }
+    return total;
+}
+
+/**
+* @brief How many packages failed to be delivered, summed over every radio
+*
+* @return number of packages
+*/
+uint64_t NRFRadioManager::failedPackets() const {
+    uint64_t total = 0;
+
+    for (int i=0;i<m_radioCount;i++) {
+        total += m_engines[i]->failedPackets();
+    }
+    return total;
+}
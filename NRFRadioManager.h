@@ -0,0 +1,66 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_RADIO_MANAGER_H
+#define NRF_RADIO_MANAGER_H
+
+#include "NRFEngine.h"
+#include <stddef.h>
+
+#define NRF_MANAGER_MAX_RADIOS 8
+
+/**
+* @brief Drives several radios at once, each one through its own NRFEngine
+* thread (optionally pinned to a CPU). Received packages from every radio are
+* merged into a single stream, and packages to send go to the least loaded
+* radio unless one is picked explicitly. Each controller is built by the
+* application with its own spidev node (the chip select), CE line and IRQ
+* line, and usually its own channel.
+*/
+class NRFRadioManager {
+    public:
+    NRFRadioManager();
+    ~NRFRadioManager();
+
+    int addRadio(NRFController* controller, int cpu = -1);
+    int radioCount() const;
+    NRFEngine* engine(int radio);
+
+    bool start();
+    void stop();
+    bool running() const;
+
+    int send(const NRFPacket& packet);
+    bool send(int radio, const NRFPacket& packet);
+    bool receive(NRFPacket& packet, int* radio = NULL);
+    int rxEventFd() const;
+    int wait(int timeoutMs = -1);
+    uint64_t droppedPackets() const;
+    uint64_t failedPackets() const;
+
+    private:
+    NRFEngine* m_engines[NRF_MANAGER_MAX_RADIOS];
+    int m_cpus[NRF_MANAGER_MAX_RADIOS];
+    int m_radioCount;
+    int m_nextTx;
+    int m_nextRx;
+    int m_epollFd;
+    bool m_running;
+};
+
+#endif
@@ -0,0 +1,182 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_REGISTERS_H
+#define NRF_REGISTERS_H
+
+#include <stdint.h>
+
+#define NRF_REG_CONFIG 0x00
+#define NRF_REG_EN_AA 0x01
+#define NRF_REG_EN_RXADDR 0x02
+#define NRF_REG_SETUP_AW 0x03
+#define NRF_REG_SETUP_RETR 0x04
+#define NRF_REG_RF_CH 0x05
+#define NRF_REG_RF_SETUP 0x06
+#define NRF_REG_STATUS 0x07
+#define NRF_REG_OBSERVE_TX 0x08
+#define NRF_REG_CD 0x09
+#define NRF_REG_RX_ADDR_P0 0x0A
+#define NRF_REG_RX_ADDR_P1 0x0B
+#define NRF_REG_RX_ADDR_P2 0x0C
+#define NRF_REG_RX_ADDR_P3 0x0D
+#define NRF_REG_RX_ADDR_P4 0x0E
+#define NRF_REG_RX_ADDR_P5 0x0F
+#define NRF_REG_TX_ADDR 0x10
+#define NRF_REG_RX_PW_P0 0x11
+#define NRF_REG_RX_PW_P1 0x12
+#define NRF_REG_RX_PW_P2 0x13
+#define NRF_REG_RX_PW_P3 0x14
+#define NRF_REG_RX_PW_P4 0x15
+#define NRF_REG_RX_PW_P5 0x16
+#define NRF_REG_FIFO_STATUS 0x017
+#define NRF_REG_DYNPD 0x1C
+#define NRF_REG_FEATURE 0x1D
+
+#define NRF_REG_COUNT (NRF_REG_FEATURE + 1)
+
+enum NRFAccess {
+    NRFReadWrite,
+    NRFReadOnly,
+    NRFWriteClear //writing 1 clears the bit, writing 0 leaves it alone
+};
+
+/**
+* @brief Compile time description of a register field
+*/
+template<uint8_t Reg, uint8_t Offset, uint8_t Width, NRFAccess Access = NRFReadWrite>
+struct NRFField {
+    static_assert(Width > 0 && Offset + Width <= 8, "field must fit in a single byte register");
+
+    static constexpr uint8_t reg = Reg;
+    static constexpr uint8_t offset = Offset;
+    static constexpr uint8_t width = Width;
+    static constexpr NRFAccess access = Access;
+    static constexpr uint8_t mask = ((1 << Width) - 1) << Offset;
+};
+
+/**
+* @brief Fields of the single byte registers, named as in the datasheet
+*/
+struct NRFReg {
+    typedef NRFField<NRF_REG_CONFIG, 6, 1> MASK_RX_DR;
+    typedef NRFField<NRF_REG_CONFIG, 5, 1> MASK_TX_DS;
+    typedef NRFField<NRF_REG_CONFIG, 4, 1> MASK_MAX_RT;
+    typedef NRFField<NRF_REG_CONFIG, 3, 1> EN_CRC;
+    typedef NRFField<NRF_REG_CONFIG, 2, 1> CRCO;
+    typedef NRFField<NRF_REG_CONFIG, 1, 1> PWR_UP;
+    typedef NRFField<NRF_REG_CONFIG, 0, 1> PRIM_RX;
+
+    typedef NRFField<NRF_REG_EN_AA, 0, 6> ENAA;
+    typedef NRFField<NRF_REG_EN_RXADDR, 0, 6> ERX;
+    typedef NRFField<NRF_REG_SETUP_AW, 0, 2> AW;
+
+    typedef NRFField<NRF_REG_SETUP_RETR, 4, 4> ARD;
+    typedef NRFField<NRF_REG_SETUP_RETR, 0, 4> ARC;
+
+    typedef NRFField<NRF_REG_RF_CH, 0, 7> RF_CH;
+
+    typedef NRFField<NRF_REG_RF_SETUP, 7, 1> CONT_WAVE;
+    typedef NRFField<NRF_REG_RF_SETUP, 5, 1> RF_DR_LOW;
+    typedef NRFField<NRF_REG_RF_SETUP, 4, 1> PLL_LOCK;
+    typedef NRFField<NRF_REG_RF_SETUP, 3, 1> RF_DR_HIGH;
+    typedef NRFField<NRF_REG_RF_SETUP, 1, 2> RF_PWR;
+
+    typedef NRFField<NRF_REG_STATUS, 6, 1, NRFWriteClear> RX_DR;
+    typedef NRFField<NRF_REG_STATUS, 5, 1, NRFWriteClear> TX_DS;
+    typedef NRFField<NRF_REG_STATUS, 4, 1, NRFWriteClear> MAX_RT;
+    typedef NRFField<NRF_REG_STATUS, 1, 3, NRFReadOnly> RX_P_NO;
+    typedef NRFField<NRF_REG_STATUS, 0, 1, NRFReadOnly> STATUS_TX_FULL;
+
+    typedef NRFField<NRF_REG_OBSERVE_TX, 4, 4, NRFReadOnly> PLOS_CNT;
+    typedef NRFField<NRF_REG_OBSERVE_TX, 0, 4, NRFReadOnly> ARC_CNT;
+
+    typedef NRFField<NRF_REG_CD, 0, 1, NRFReadOnly> RPD;
+
+    typedef NRFField<NRF_REG_FIFO_STATUS, 6, 1, NRFReadOnly> TX_REUSE;
+    typedef NRFField<NRF_REG_FIFO_STATUS, 5, 1, NRFReadOnly> FIFO_TX_FULL;
+    typedef NRFField<NRF_REG_FIFO_STATUS, 4, 1, NRFReadOnly> TX_EMPTY;
+    typedef NRFField<NRF_REG_FIFO_STATUS, 1, 1, NRFReadOnly> RX_FULL;
+    typedef NRFField<NRF_REG_FIFO_STATUS, 0, 1, NRFReadOnly> RX_EMPTY;
+
+    typedef NRFField<NRF_REG_DYNPD, 0, 6> DPL;
+
+    typedef NRFField<NRF_REG_FEATURE, 2, 1> EN_DPL;
+    typedef NRFField<NRF_REG_FEATURE, 1, 1> EN_ACK_PAY;
+    typedef NRFField<NRF_REG_FEATURE, 0, 1> EN_DYN_ACK;
+};
+
+/**
+* @brief A value for a field, already shifted into place
+*/
+template<class Field>
+struct NRFFieldValue {
+    uint8_t bits;
+};
+
+template<class Field>
+constexpr NRFFieldValue<Field> nrfField(uint8_t value) {
+    return NRFFieldValue<Field>{static_cast<uint8_t>((value << Field::offset) & Field::mask)};
+}
+
+/**
+* @brief Extract a field from a raw register value, shifted down to bit 0
+*/
+template<class Field>
+constexpr uint8_t nrfFieldValue(uint8_t regValue) {
+    return static_cast<uint8_t>((regValue & Field::mask) >> Field::offset);
+}
+
+/**
+* @brief Properties of a group of fields updated together, all computed at
+* compile time
+*/
+template<class... Fields>
+struct NRFFieldSet;
+
+template<class Field>
+struct NRFFieldSet<Field> {
+    static constexpr uint8_t reg = Field::reg;
+    static constexpr uint8_t mask = Field::mask;
+    static constexpr bool sameRegister = true;
+    static constexpr bool overlapping = false;
+    static constexpr bool writable = Field::access == NRFReadWrite;
+};
+
+template<class Field, class... Rest>
+struct NRFFieldSet<Field, Rest...> {
+    static constexpr uint8_t reg = Field::reg;
+    static constexpr uint8_t mask = Field::mask | NRFFieldSet<Rest...>::mask;
+    static constexpr bool sameRegister = Field::reg == NRFFieldSet<Rest...>::reg &&
+        NRFFieldSet<Rest...>::sameRegister;
+    static constexpr bool overlapping = (Field::mask & NRFFieldSet<Rest...>::mask) != 0 ||
+        NRFFieldSet<Rest...>::overlapping;
+    static constexpr bool writable = Field::access == NRFReadWrite &&
+        NRFFieldSet<Rest...>::writable;
+};
+
+inline uint8_t nrfFieldBits() {
+    return 0;
+}
+
+template<class Field, class... Rest>
+inline uint8_t nrfFieldBits(NRFFieldValue<Field> value, NRFFieldValue<Rest>... rest) {
+    return value.bits | nrfFieldBits(rest...);
+}
+
+#endif
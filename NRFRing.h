@@ -0,0 +1,141 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_RING_H
+#define NRF_RING_H
+
+#include <atomic>
+#include <stddef.h>
+
+#define NRF_CACHE_LINE_SIZE 64
+
+/**
+* @brief Lock free ring buffer for exactly one producer thread and one
+* consumer thread. Slots are preallocated, so no allocation happens while
+* moving items around.
+*
+* @tparam T item type
+* @tparam Size number of slots. Must be a power of 2. One slot is kept free to
+* tell full from empty
+*/
+template <typename T, size_t Size>
+class NRFRing {
+    public:
+    NRFRing() : m_head(0), m_tail(0) {
+        static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "ring size must be a power of 2");
+    }
+
+    /**
+    * @brief Get the next free slot, to be filled in place and then published
+    * with commit(). Producer side only.
+    *
+    * @return pointer to the slot, or NULL if the ring is full
+    */
+    T* reserve() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (((head + 1) & (Size - 1)) == m_tail.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &m_slots[head];
+    }
+
+    /**
+    * @brief Publish the slot returned by reserve(). Producer side only.
+    */
+    void commit() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        m_head.store((head + 1) & (Size - 1), std::memory_order_release);
+    }
+
+    /**
+    * @brief Copy an item into the ring. Producer side only.
+    *
+    * @return true for success, false if the ring is full
+    */
+    bool push(const T& item) {
+        T* slot = reserve();
+        if (!slot) {
+            return false;
+        }
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    /**
+    * @brief Get the oldest item, to be used in place and then released with
+    * release(). Consumer side only.
+    *
+    * @return pointer to the item, or NULL if the ring is empty
+    */
+    T* front() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &m_slots[tail];
+    }
+
+    /**
+    * @brief Give the slot returned by front() back to the producer. Consumer
+    * side only.
+    */
+    void release() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_tail.store((tail + 1) & (Size - 1), std::memory_order_release);
+    }
+
+    /**
+    * @brief Copy the oldest item out of the ring. Consumer side only.
+    *
+    * @return true for success, false if the ring is empty
+    */
+    bool pop(T& item) {
+        T* slot = front();
+        if (!slot) {
+            return false;
+        }
+        item = *slot;
+        release();
+        return true;
+    }
+
+    /**
+    * @brief Tell if there's nothing to consume. Exact on the consumer side,
+    * a hint anywhere else.
+    */
+    bool empty() const {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+    /**
+    * @brief Get how many items are waiting. Exact on either side for the
+    * items that side can see, a hint anywhere else.
+    */
+    size_t size() const {
+        return (m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire)) & (Size - 1);
+    }
+
+    private:
+    //producer and consumer indexes live in different cache lines
+    alignas(NRF_CACHE_LINE_SIZE) std::atomic<size_t> m_head;
+    alignas(NRF_CACHE_LINE_SIZE) std::atomic<size_t> m_tail;
+    alignas(NRF_CACHE_LINE_SIZE) T m_slots[Size];
+};
+
+#endif
@@ -0,0 +1,835 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFSimulator.h"
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+
+#define NRF_SIM_NEVER UINT64_MAX
+//PLL settling before every transmission and before listening for an ACK
+#define NRF_SIM_SETTLE_US 130
+#define NRF_SIM_CE_PULSE_US 10
+
+static uint64_t nowUs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+NRFSimulator::NRFSimulator() {
+    struct epoll_event ev;
+
+    m_link = NULL;
+    m_lock = &m_ownLock;
+    m_open = false;
+    m_spiTransactNs = 0;
+    m_spiByteNs = 0;
+    m_speed = NRF_SPI_DEFAULT_SPEED;
+    m_speedLimit = 0;
+    m_airScale = 1.0;
+    m_timerAt = NRF_SIM_NEVER;
+    resetCounters();
+
+    //IRQ "pin": readable when flags are raised, or when a transmission in
+    //flight is due and someone must call waitIRQ() to let it complete
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &ev);
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_timerFd, &ev);
+
+    reset();
+}
+
+NRFSimulator::~NRFSimulator() {
+    if (m_link) {
+        m_link->detach(this);
+    }
+    close(m_epollFd);
+    close(m_timerFd);
+    close(m_eventFd);
+}
+
+/**
+* @brief Simulated modules are always there, this only enables the transport
+*
+* @return 0, for success
+*/
+int NRFSimulator::openDevice() {
+    m_open = true;
+    return 0;
+}
+
+void NRFSimulator::closeDevice() {
+    m_open = false;
+}
+
+/**
+* @brief Put the module in the state it has right after power on
+*/
+void NRFSimulator::reset() {
+    std::lock_guard<std::mutex> lock(*m_lock);
+
+    memset(m_regs, 0, sizeof(m_regs));
+    m_regs[NRF_REG_CONFIG][0] = 0x08;
+    m_regs[NRF_REG_EN_AA][0] = 0x3F;
+    m_regs[NRF_REG_EN_RXADDR][0] = 0x03;
+    m_regs[NRF_REG_SETUP_AW][0] = 0x03;
+    m_regs[NRF_REG_SETUP_RETR][0] = 0x03;
+    m_regs[NRF_REG_RF_CH][0] = 0x02;
+    m_regs[NRF_REG_RF_SETUP][0] = 0x0E;
+    memset(m_regs[NRF_REG_RX_ADDR_P0], 0xE7, NRF_MAX_ADDRESS_SIZE);
+    memset(m_regs[NRF_REG_RX_ADDR_P1], 0xC2, NRF_MAX_ADDRESS_SIZE);
+    m_regs[NRF_REG_RX_ADDR_P2][0] = 0xC3;
+    m_regs[NRF_REG_RX_ADDR_P3][0] = 0xC4;
+    m_regs[NRF_REG_RX_ADDR_P4][0] = 0xC5;
+    m_regs[NRF_REG_RX_ADDR_P5][0] = 0xC6;
+    memset(m_regs[NRF_REG_TX_ADDR], 0xE7, NRF_MAX_ADDRESS_SIZE);
+
+    m_flags = 0;
+    m_observeTx = 0;
+    m_rxFifo.clear();
+    m_txFifo.clear();
+    m_reuse = false;
+    m_ce = false;
+    m_ceRise = 0;
+    m_txActive = false;
+    m_startedSinceRise = false;
+    m_txAttempt = 0;
+    m_txDone = 0;
+    m_txReady = 0;
+    m_txHasAck = false;
+}
+
+/**
+* @brief Make every SPI command cost some time, to model the real bus
+*
+* @param transactNs fixed cost of each command (syscall, CS toggling), in nanoseconds
+* @param byteNs cost of each byte clocked, in nanoseconds. 8000 models a 1MHz clock
+*/
+void NRFSimulator::setSpiLatency(uint32_t transactNs, uint32_t byteNs) {
+    m_spiTransactNs = transactNs;
+    m_spiByteNs = byteNs;
+}
+
+/**
+* @brief Change the modelled SPI clock. Each byte then costs 8 clock cycles,
+* until setSpiLatency() is called again.
+*
+* @param hz clock frequency, in Hz
+*
+* @return true for success, false otherwise
+*/
+bool NRFSimulator::setSpeed(uint32_t hz) {
+    if (hz == 0) {
+        return false;
+    }
+
+    m_speed = hz;
+    m_spiByteNs = 8000000000ULL / hz;
+    return true;
+}
+
+uint32_t NRFSimulator::speed() const {
+    return m_speed;
+}
+
+/**
+* @brief Model wiring that can't take fast clocks: above this speed, bytes
+* clocked out of the module are corrupted
+*
+* @param hz fastest reliable clock, in Hz. 0 means no limit
+*/
+void NRFSimulator::setSpeedLimit(uint32_t hz) {
+    m_speedLimit = hz;
+}
+
+/**
+* @brief Scale time spent on the air. 1.0 follows the datasheet timings, 0
+* makes transmissions complete instantly.
+*
+* @param scale factor applied to every air time
+*/
+void NRFSimulator::setAirTimeScale(double scale) {
+    m_airScale = scale;
+}
+
+/**
+* @brief How many SPI commands the module received
+*/
+uint64_t NRFSimulator::transactions() const {
+    return m_transactions;
+}
+
+/**
+* @brief How many transport submissions were made. A batch of commands counts once.
+*/
+uint64_t NRFSimulator::submissions() const {
+    return m_submissions;
+}
+
+/**
+* @brief How many bytes were clocked over SPI
+*/
+uint64_t NRFSimulator::spiBytes() const {
+    return m_spiBytes;
+}
+
+void NRFSimulator::resetCounters() {
+    m_transactions = 0;
+    m_submissions = 0;
+    m_spiBytes = 0;
+}
+
+bool NRFSimulator::setCE() {
+    std::lock_guard<std::mutex> lock(*m_lock);
+    uint64_t now = nowUs();
+
+    update(now);
+    if (!m_ce) {
+        m_ce = true;
+        m_ceRise = now;
+        m_startedSinceRise = false;
+    }
+    update(now);
+    return true;
+}
+
+bool NRFSimulator::clearCE() {
+    std::lock_guard<std::mutex> lock(*m_lock);
+    uint64_t now = nowUs();
+
+    update(now);
+    if (m_ce) {
+        m_ce = false;
+        //too short a pulse doesn't start anything
+        if (now - m_ceRise < NRF_SIM_CE_PULSE_US && m_txActive &&
+                m_startedSinceRise && m_txAttempt == 0) {
+            m_txActive = false;
+        }
+    }
+    update(now);
+    return true;
+}
+
+bool NRFSimulator::transfer(const NRFTransfer* transfers, int count) {
+    if (!m_open) {
+        return false;
+    }
+
+    for (int i=0;i<count;i++) {
+        spiDelay(transfers[i].size);
+    }
+
+    for (int i=0;i<count;i++) {
+        {
+            std::lock_guard<std::mutex> lock(*m_lock);
+            if (i == 0) {
+                m_submissions++;
+            }
+            m_transactions++;
+            m_spiBytes += transfers[i].size;
+            command(transfers[i].tx, transfers[i].rx, transfers[i].size, nowUs());
+        }
+        if (m_speedLimit && m_speed > m_speedLimit) {
+            //MISO edges too slow for the clock, bits get shifted around
+            for (int j=1;j<transfers[i].size;j++) {
+                transfers[i].rx[j] ^= 1 << (j % 8);
+            }
+        }
+        //the other radios keep running while this one waits
+        busyWait((uint64_t)transfers[i].delayUs * 1000);
+    }
+    return true;
+}
+
+/**
+* @brief Descriptor that becomes readable when IRQ may have been asserted.
+* Wakeups may be spurious; call waitIRQ() with a zero timeout to find out.
+*/
+int NRFSimulator::irqFd() const {
+    return m_epollFd;
+}
+
+bool NRFSimulator::irqAsserted() {
+    std::lock_guard<std::mutex> lock(*m_lock);
+
+    update(nowUs());
+    return m_flags & ~m_regs[NRF_REG_CONFIG][0] & NRF_STATUS_IRQ_MASK;
+}
+
+int NRFSimulator::waitIRQ(int timeoutMs) {
+    uint64_t deadline = NRF_SIM_NEVER;
+    uint64_t value;
+    ssize_t ret;
+
+    if (timeoutMs >= 0) {
+        deadline = nowUs() + (uint64_t)timeoutMs * 1000;
+    }
+
+    while (true) {
+        uint64_t now = nowUs();
+        uint64_t wake = deadline;
+        bool asserted;
+
+        {
+            std::lock_guard<std::mutex> lock(*m_lock);
+            update(now);
+            asserted = m_flags & ~m_regs[NRF_REG_CONFIG][0] & NRF_STATUS_IRQ_MASK;
+            if (m_txActive && m_txDone < wake) {
+                wake = m_txDone;
+            }
+        }
+
+        ret = read(m_eventFd, &value, sizeof(value));
+        ret = read(m_timerFd, &value, sizeof(value));
+        (void)ret;
+
+        if (asserted) {
+            return 1;
+        }
+        if (now >= deadline) {
+            return 0;
+        }
+
+        struct pollfd pfd;
+        struct timespec timeout;
+        pfd.fd = m_eventFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (wake != NRF_SIM_NEVER) {
+            uint64_t us = wake > now ? wake - now : 0;
+            timeout.tv_sec = us / 1000000;
+            timeout.tv_nsec = (us % 1000000) * 1000;
+        }
+        ppoll(&pfd, 1, wake == NRF_SIM_NEVER ? NULL : &timeout, NULL);
+    }
+}
+
+/**
+* @brief Execute one SPI command, as the chip would
+*/
+void NRFSimulator::command(const uint8_t* tx, uint8_t* rx, int n, uint64_t now) {
+    uint8_t mosi[NRF_MAX_PAYLOAD_SIZE+1];
+    uint8_t cmd = tx[0];
+    uint8_t reg = cmd & 0x1F;
+
+    //in place transfers share tx and rx. The chip latches MOSI while driving
+    //MISO, so keep what was sent before answering. No command uses more bytes
+    if (n > (int)sizeof(mosi)) {
+        n = sizeof(mosi);
+    }
+    memcpy(mosi, tx, n);
+    tx = mosi;
+
+    update(now);
+
+    memset(rx, 0, n);
+    rx[0] = statusRegister();
+
+    if ((cmd & 0xE0) == NRF_R_REGISTER) {
+        for (int i=1;i<n && i<=NRF_MAX_ADDRESS_SIZE;i++) {
+            switch (reg) {
+                case NRF_REG_STATUS:
+                    rx[i] = statusRegister();
+                    break;
+                case NRF_REG_OBSERVE_TX:
+                    rx[i] = m_observeTx;
+                    break;
+                case NRF_REG_CD:
+                    rx[i] = m_link && (m_regs[NRF_REG_CONFIG][0] & 0x01) && m_ce &&
+                        m_link->busy(m_regs[NRF_REG_RF_CH][0] & 0x7F);
+                    break;
+                case NRF_REG_FIFO_STATUS:
+                    rx[i] = fifoStatusRegister();
+                    break;
+                default:
+                    if (reg < NRF_REG_COUNT) {
+                        rx[i] = m_regs[reg][i-1];
+                    }
+            }
+        }
+    }
+    else if ((cmd & 0xE0) == NRF_W_REGISTER) {
+        switch (reg) {
+            case NRF_REG_STATUS:
+                if (n > 1 && (tx[1] & m_flags & NRF_STATUS_IRQ_MASK)) {
+                    m_flags &= ~(tx[1] & NRF_STATUS_IRQ_MASK);
+                    m_txReady = now;
+                }
+                break;
+            case NRF_REG_OBSERVE_TX:
+            case NRF_REG_CD:
+            case NRF_REG_FIFO_STATUS:
+                //read only
+                break;
+            case NRF_REG_RF_CH:
+                //changing channel resets lost packages count
+                m_observeTx &= 0x0F;
+                //fall through
+            default:
+                if (reg < NRF_REG_COUNT) {
+                    memcpy(m_regs[reg], tx+1, n-1 < NRF_MAX_ADDRESS_SIZE ? n-1 : NRF_MAX_ADDRESS_SIZE);
+                }
+        }
+    }
+    else if (cmd == NRF_R_RX_PAYLOAD) {
+        if (!m_rxFifo.empty()) {
+            memcpy(rx+1, m_rxFifo.front().data, n-1 < m_rxFifo.front().size ? n-1 : m_rxFifo.front().size);
+            m_rxFifo.pop_front();
+        }
+    }
+    else if (cmd == NRF_R_RX_PL_WID) {
+        if (n > 1 && !m_rxFifo.empty()) {
+            rx[1] = m_rxFifo.front().size;
+        }
+    }
+    else if (cmd == NRF_W_TX_PAYLOAD || (cmd & 0xF8) == NRF_W_ACK_PAYLOAD ||
+            (cmd == NRF_W_TX_PAYLOAD_NOACK && (m_regs[NRF_REG_FEATURE][0] & NRF_FEATURE_EN_DYN_ACK))) {
+        if (m_txFifo.size() < NRF_TX_FIFO_DEPTH && n > 1) {
+            Payload payload;
+            memset(&payload, 0, sizeof(payload));
+            payload.pipe = (cmd & 0xF8) == NRF_W_ACK_PAYLOAD ? (cmd & 0x07) : 0xFF;
+            payload.size = n-1 < NRF_MAX_PAYLOAD_SIZE ? n-1 : NRF_MAX_PAYLOAD_SIZE;
+            payload.noAck = cmd == NRF_W_TX_PAYLOAD_NOACK;
+            memcpy(payload.data, tx+1, payload.size);
+            m_txFifo.push_back(payload);
+            m_reuse = false;
+            m_txReady = now;
+        }
+    }
+    else if (cmd == NRF_FLUSH_TX) {
+        m_txFifo.clear();
+        m_txActive = false;
+        m_reuse = false;
+    }
+    else if (cmd == NRF_FLUSH_RX) {
+        m_rxFifo.clear();
+    }
+    else if (cmd == NRF_REUSE_TX_PL) {
+        m_reuse = true;
+    }
+
+    update(now);
+}
+
+/**
+* @brief Advance transmissions up to a point in time
+*/
+void NRFSimulator::update(uint64_t now) {
+    while (true) {
+        if (m_txActive) {
+            if (now < m_txDone) {
+                break;
+            }
+            finishAttempt();
+            continue;
+        }
+
+        if (!canTransmit()) {
+            break;
+        }
+
+        uint64_t start = m_txReady > m_ceRise ? m_txReady : m_ceRise;
+        m_txActive = true;
+        m_txAttempt = 0;
+        m_startedSinceRise = true;
+        m_txDone = start + attemptUs(m_txFifo.front().size, expectAck(), 0);
+    }
+
+    armTimer();
+}
+
+bool NRFSimulator::canTransmit() const {
+    uint8_t regConfig = m_regs[NRF_REG_CONFIG][0];
+
+    //powered up, in PTX mode, with CE high and something to send
+    return m_open && (regConfig & 0x02) && !(regConfig & 0x01) && m_ce &&
+        !m_txFifo.empty() && !(m_flags & NRF_STATUS_MAX_RT);
+}
+
+bool NRFSimulator::expectAck() const {
+    return !m_txFifo.front().noAck && (m_regs[NRF_REG_EN_AA][0] & 0x01);
+}
+
+/**
+* @brief Put current package on the air and decide what comes next
+*/
+void NRFSimulator::finishAttempt() {
+    uint8_t arc = m_regs[NRF_REG_SETUP_RETR][0] & 0x0F;
+    uint64_t ard = ((m_regs[NRF_REG_SETUP_RETR][0] >> 4) + 1) * 250;
+    uint64_t end = m_txDone;
+    bool acked = false;
+
+    m_txHasAck = false;
+    if (m_link) {
+        acked = m_link->deliver(this, m_txFifo.front(), m_txAck, m_txHasAck);
+    }
+
+    if (acked || !expectAck()) {
+        if (!m_reuse) {
+            m_txFifo.pop_front();
+        }
+        m_observeTx = (m_observeTx & 0xF0) | m_txAttempt;
+        if (m_txHasAck && m_rxFifo.size() < NRF_RX_FIFO_DEPTH) {
+            m_txAck.pipe = 0;
+            m_rxFifo.push_back(m_txAck);
+            setFlags(NRF_STATUS_RX_DR);
+        }
+        setFlags(NRF_STATUS_TX_DS);
+        m_txActive = false;
+        m_txReady = end;
+        return;
+    }
+
+    if (m_txAttempt < arc) {
+        //no ACK, try again after ARD
+        m_txAttempt++;
+        m_txDone = end + ard * m_airScale + attemptUs(m_txFifo.front().size, true, 0);
+        return;
+    }
+
+    if ((m_observeTx >> 4) < 15) {
+        m_observeTx += 0x10;
+    }
+    m_observeTx = (m_observeTx & 0xF0) | arc;
+    setFlags(NRF_STATUS_MAX_RT);
+    m_txActive = false;
+    m_txReady = end;
+}
+
+/**
+* @brief Time a single transmission attempt takes, following the datasheet
+*/
+uint64_t NRFSimulator::attemptUs(int size, bool withAck, int ackSize) const {
+    uint8_t regConfig = m_regs[NRF_REG_CONFIG][0];
+    uint8_t regRfSetup = m_regs[NRF_REG_RF_SETUP][0];
+    int aw = (m_regs[NRF_REG_SETUP_AW][0] & 0x03) + 2;
+    int crc = (regConfig & 0x08) ? ((regConfig & 0x04) ? 2 : 1) : 0;
+    double bitsPerUs = 1.0;
+    double us;
+
+    if (regRfSetup & 0x20) {
+        bitsPerUs = 0.25;
+    }
+    else if (regRfSetup & 0x08) {
+        bitsPerUs = 2.0;
+    }
+
+    //preamble, address, 9 bit control field, payload and CRC
+    us = NRF_SIM_SETTLE_US + (8 * (1 + aw + size + crc) + 9) / bitsPerUs;
+    if (withAck) {
+        us += NRF_SIM_SETTLE_US + (8 * (1 + aw + ackSize + crc) + 9) / bitsPerUs;
+    }
+
+    return us * m_airScale;
+}
+
+/**
+* @brief Called by the air link when a package reaches this module
+*
+* @return true if the module acknowledged the package
+*/
+bool NRFSimulator::receive(const uint8_t* address, uint8_t channel, uint8_t rfSetup,
+        const Payload& payload, Payload& ack, bool& hasAck) {
+    uint8_t regConfig = m_regs[NRF_REG_CONFIG][0];
+    uint8_t pipe;
+    bool dynamic;
+
+    //powered up, in PRX mode and listening
+    if (!m_open || !(regConfig & 0x02) || !(regConfig & 0x01) || !m_ce) {
+        return false;
+    }
+
+    if ((m_regs[NRF_REG_RF_CH][0] & 0x7F) != channel ||
+            (m_regs[NRF_REG_RF_SETUP][0] & 0x28) != (rfSetup & 0x28)) {
+        return false;
+    }
+
+    if (!rxPipe(address, pipe)) {
+        return false;
+    }
+
+    dynamic = (m_regs[NRF_REG_FEATURE][0] & NRF_FEATURE_EN_DPL) &&
+        (m_regs[NRF_REG_DYNPD][0] & (1 << pipe));
+    if (!dynamic && payload.size != m_regs[NRF_REG_RX_PW_P0 + pipe][0]) {
+        return false;
+    }
+
+    //a full FIFO drops the package and doesn't acknowledge it
+    if (m_rxFifo.size() >= NRF_RX_FIFO_DEPTH) {
+        return false;
+    }
+
+    m_rxFifo.push_back(payload);
+    m_rxFifo.back().pipe = pipe;
+    setFlags(NRF_STATUS_RX_DR);
+
+    if (payload.noAck || !(m_regs[NRF_REG_EN_AA][0] & (1 << pipe))) {
+        return false;
+    }
+
+    if (!hasAck && (m_regs[NRF_REG_FEATURE][0] & NRF_FEATURE_EN_ACK_PAY)) {
+        for (std::deque<Payload>::iterator it = m_txFifo.begin(); it != m_txFifo.end(); ++it) {
+            if (it->pipe == pipe) {
+                ack = *it;
+                hasAck = true;
+                m_txFifo.erase(it);
+                setFlags(NRF_STATUS_TX_DS);
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+* @brief Find which enabled pipe listens to an address
+*/
+bool NRFSimulator::rxPipe(const uint8_t* address, uint8_t& pipe) const {
+    int aw = (m_regs[NRF_REG_SETUP_AW][0] & 0x03) + 2;
+
+    for (pipe=0;pipe<NRF_PIPE_COUNT;pipe++) {
+        if (!(m_regs[NRF_REG_EN_RXADDR][0] & (1 << pipe))) {
+            continue;
+        }
+
+        if (pipe < 2) {
+            if (memcmp(m_regs[NRF_REG_RX_ADDR_P0 + pipe], address, aw) == 0) {
+                return true;
+            }
+        }
+        //pipes 2 to 5 share all but the LSB with pipe 1
+        else if (m_regs[NRF_REG_RX_ADDR_P0 + pipe][0] == address[0] &&
+                memcmp(m_regs[NRF_REG_RX_ADDR_P1] + 1, address + 1, aw - 1) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint8_t NRFSimulator::statusRegister() const {
+    uint8_t regStatus = m_flags;
+
+    if (m_rxFifo.empty()) {
+        regStatus |= NRF_STATUS_RX_P_NO_EMPTY;
+    }
+    else {
+        regStatus |= m_rxFifo.front().pipe << 1;
+    }
+
+    if (m_txFifo.size() >= NRF_TX_FIFO_DEPTH) {
+        regStatus |= NRF_STATUS_TX_FULL;
+    }
+
+    return regStatus;
+}
+
+uint8_t NRFSimulator::fifoStatusRegister() const {
+    uint8_t regFifoStatus = 0;
+
+    if (m_reuse) {
+        regFifoStatus |= 0x40;
+    }
+    if (m_txFifo.size() >= NRF_TX_FIFO_DEPTH) {
+        regFifoStatus |= NRF_FIFO_STATUS_TX_FULL;
+    }
+    if (m_txFifo.empty()) {
+        regFifoStatus |= NRF_FIFO_STATUS_TX_EMPTY;
+    }
+    if (m_rxFifo.size() >= NRF_RX_FIFO_DEPTH) {
+        regFifoStatus |= NRF_FIFO_STATUS_RX_FULL;
+    }
+    if (m_rxFifo.empty()) {
+        regFifoStatus |= NRF_FIFO_STATUS_RX_EMPTY;
+    }
+
+    return regFifoStatus;
+}
+
+void NRFSimulator::setFlags(uint8_t flags) {
+    uint64_t one = 1;
+    ssize_t ret;
+
+    m_flags |= flags;
+    if (m_flags & ~m_regs[NRF_REG_CONFIG][0] & NRF_STATUS_IRQ_MASK) {
+        ret = write(m_eventFd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+/**
+* @brief Make irqFd() readable when the transmission in flight is due
+*/
+void NRFSimulator::armTimer() {
+    struct itimerspec spec;
+    uint64_t at = m_txActive ? m_txDone : NRF_SIM_NEVER;
+
+    if (at == m_timerAt) {
+        return;
+    }
+    m_timerAt = at;
+
+    memset(&spec, 0, sizeof(spec));
+    if (at != NRF_SIM_NEVER) {
+        //zero would disarm the timer
+        if (at == 0) {
+            at = 1;
+        }
+        spec.it_value.tv_sec = at / 1000000;
+        spec.it_value.tv_nsec = (at % 1000000) * 1000;
+    }
+    timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void NRFSimulator::spiDelay(int n) const {
+    busyWait(m_spiTransactNs + (uint64_t)n * m_spiByteNs);
+}
+
+void NRFSimulator::busyWait(uint64_t ns) {
+    struct timespec start;
+    struct timespec now;
+
+    if (ns == 0) {
+        return;
+    }
+
+    //busy wait, sleeping would be way too coarse
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000000 + now.tv_nsec - start.tv_nsec < ns);
+}
+
+NRFAirLink::NRFAirLink() {
+    for (int i=0;i<NRF_CHANNEL_COUNT;i++) {
+        m_loss[i] = 0;
+        m_busy[i] = false;
+    }
+    m_random = 2463534242UL;
+}
+
+NRFAirLink::~NRFAirLink() {
+    while (!m_radios.empty()) {
+        detach(m_radios.back());
+    }
+}
+
+/**
+* @brief Put a simulated module on the air. Do it before using the module.
+*/
+void NRFAirLink::attach(NRFSimulator* radio) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    //every module on the link shares one lock, so deliveries are consistent
+    radio->m_link = this;
+    radio->m_lock = &m_lock;
+    m_radios.push_back(radio);
+}
+
+void NRFAirLink::detach(NRFSimulator* radio) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (size_t i=0;i<m_radios.size();i++) {
+        if (m_radios[i] == radio) {
+            m_radios.erase(m_radios.begin() + i);
+            radio->m_link = NULL;
+            radio->m_lock = &radio->m_ownLock;
+            break;
+        }
+    }
+}
+
+/**
+* @brief Make a fraction of transmission attempts on a channel get lost
+*
+* @param channel RF channel
+* @param probability from 0 (clean channel) to 1 (nothing gets through)
+*/
+void NRFAirLink::setLoss(uint8_t channel, double probability) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (channel < NRF_CHANNEL_COUNT) {
+        m_loss[channel] = probability;
+    }
+}
+
+/**
+* @brief Simulate a foreign signal on a channel, seen through RPD
+*
+* @param channel RF channel
+* @param busy true if there's something strong on the channel
+*/
+void NRFAirLink::setBusy(uint8_t channel, bool busy) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (channel < NRF_CHANNEL_COUNT) {
+        m_busy[channel] = busy;
+    }
+}
+
+bool NRFAirLink::deliver(NRFSimulator* sender, const NRFSimulator::Payload& payload,
+        NRFSimulator::Payload& ack, bool& hasAck) {
+    uint8_t channel = sender->m_regs[NRF_REG_RF_CH][0] & 0x7F;
+    bool acked = false;
+
+    if (channel < NRF_CHANNEL_COUNT && random() < m_loss[channel]) {
+        return false;
+    }
+
+    for (size_t i=0;i<m_radios.size();i++) {
+        if (m_radios[i] == sender) {
+            continue;
+        }
+        acked |= m_radios[i]->receive(sender->m_regs[NRF_REG_TX_ADDR], channel,
+                sender->m_regs[NRF_REG_RF_SETUP][0], payload, ack, hasAck);
+    }
+
+    return acked;
+}
+
+bool NRFAirLink::busy(uint8_t channel) const {
+    if (channel < NRF_CHANNEL_COUNT && m_busy[channel]) {
+        return true;
+    }
+
+    for (size_t i=0;i<m_radios.size();i++) {
+        if (m_radios[i]->m_txActive && (m_radios[i]->m_regs[NRF_REG_RF_CH][0] & 0x7F) == channel) {
+            return true;
+        }
+    }
+    return false;
+}
+
+double NRFAirLink::random() {
+    //xorshift32, good enough to drop packages
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return m_random / 4294967296.0;
+}
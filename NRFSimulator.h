@@ -0,0 +1,158 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_SIMULATOR_H
+#define NRF_SIMULATOR_H
+
+#include "NRFTransport.h"
+#include "NRFController.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class NRFAirLink;
+
+/**
+* @brief Software model of a NRF24L01+ module, seen through the same interface
+* as real hardware. It keeps the register file, TX and RX FIFOs, STATUS and
+* IRQ semantics, CE timing (a pulse shorter than 10us sends nothing) and the
+* Enhanced ShockBurst retransmission logic. SPI and air latencies are
+* configurable. Attach two or more instances to a NRFAirLink to let them talk.
+*/
+class NRFSimulator : public NRFTransport {
+    public:
+    NRFSimulator();
+    ~NRFSimulator();
+
+    int openDevice();
+    void closeDevice();
+    bool setCE();
+    bool clearCE();
+    int irqFd() const;
+    bool irqAsserted();
+    int waitIRQ(int timeoutMs);
+    bool setSpeed(uint32_t hz);
+    uint32_t speed() const;
+
+    void reset();
+    void setSpiLatency(uint32_t transactNs, uint32_t byteNs);
+    void setSpeedLimit(uint32_t hz);
+    void setAirTimeScale(double scale);
+    uint64_t transactions() const;
+    uint64_t submissions() const;
+    uint64_t spiBytes() const;
+    void resetCounters();
+
+    protected:
+    bool transfer(const NRFTransfer* transfers, int count);
+
+    private:
+    friend class NRFAirLink;
+
+    struct Payload {
+        uint8_t pipe;
+        uint8_t size;
+        bool noAck;
+        uint8_t data[NRF_MAX_PAYLOAD_SIZE];
+    };
+
+    void command(const uint8_t* tx, uint8_t* rx, int n, uint64_t now);
+    void update(uint64_t now);
+    bool canTransmit() const;
+    bool expectAck() const;
+    void finishAttempt();
+    uint64_t attemptUs(int size, bool withAck, int ackSize) const;
+    bool receive(const uint8_t* address, uint8_t channel, uint8_t rfSetup,
+            const Payload& payload, Payload& ack, bool& hasAck);
+    bool rxPipe(const uint8_t* address, uint8_t& pipe) const;
+    uint8_t statusRegister() const;
+    uint8_t fifoStatusRegister() const;
+    void setFlags(uint8_t flags);
+    void armTimer();
+    void spiDelay(int n) const;
+    static void busyWait(uint64_t ns);
+
+    NRFAirLink* m_link;
+    std::mutex m_ownLock;
+    std::mutex* m_lock;
+    bool m_open;
+
+    uint8_t m_regs[NRF_REG_COUNT][NRF_MAX_ADDRESS_SIZE];
+    uint8_t m_flags;
+    uint8_t m_observeTx;
+    std::deque<Payload> m_rxFifo;
+    std::deque<Payload> m_txFifo;
+    bool m_reuse;
+
+    bool m_ce;
+    uint64_t m_ceRise;
+    bool m_txActive;
+    bool m_startedSinceRise;
+    int m_txAttempt;
+    uint64_t m_txDone;
+    uint64_t m_txReady;
+    bool m_txAcked;
+    Payload m_txAck;
+    bool m_txHasAck;
+
+    uint32_t m_spiTransactNs;
+    uint32_t m_spiByteNs;
+    uint32_t m_speed;
+    uint32_t m_speedLimit;
+    double m_airScale;
+    uint64_t m_transactions;
+    uint64_t m_submissions;
+    uint64_t m_spiBytes;
+
+    int m_eventFd;
+    int m_timerFd;
+    uint64_t m_timerAt;
+    int m_epollFd;
+};
+
+/**
+* @brief Virtual air connecting simulated modules. A package reaches every
+* module listening on the same channel, data rate and address, subject to a
+* configurable per channel loss rate.
+*/
+class NRFAirLink {
+    public:
+    NRFAirLink();
+    ~NRFAirLink();
+
+    void attach(NRFSimulator* radio);
+    void detach(NRFSimulator* radio);
+    void setLoss(uint8_t channel, double probability);
+    void setBusy(uint8_t channel, bool busy);
+
+    private:
+    friend class NRFSimulator;
+
+    bool deliver(NRFSimulator* sender, const NRFSimulator::Payload& payload,
+            NRFSimulator::Payload& ack, bool& hasAck);
+    bool busy(uint8_t channel) const;
+    double random();
+
+    std::mutex m_lock;
+    std::vector<NRFSimulator*> m_radios;
+    double m_loss[NRF_CHANNEL_COUNT];
+    bool m_busy[NRF_CHANNEL_COUNT];
+    uint32_t m_random;
+};
+
+#endif
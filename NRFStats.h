@@ -0,0 +1,155 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_STATS_H
+#define NRF_STATS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    Hot path instrumentation. Build with -DNRF_DISABLE_STATS to compile every
+    counter update and timestamp out; the structs stay, filled with zeros.
+*/
+#ifndef NRF_DISABLE_STATS
+#define NRF_STATS(statement) statement
+#else
+#define NRF_STATS(statement)
+#endif
+
+#define NRF_HISTOGRAM_BUCKETS 32
+
+static inline uint64_t nrfStatsNowNs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+* @brief Latency histogram with power of 2 buckets. Bucket i counts samples
+* from 2^i to 2^(i+1)-1 nanoseconds; the last one also holds anything longer.
+*/
+struct NRFHistogram {
+    uint64_t buckets[NRF_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+
+    NRFHistogram() {
+        reset();
+    }
+
+    void reset() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void record(uint64_t ns) {
+        int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+        if (bucket >= NRF_HISTOGRAM_BUCKETS) {
+            bucket = NRF_HISTOGRAM_BUCKETS - 1;
+        }
+        buckets[bucket]++;
+        count++;
+        totalNs += ns;
+        if (ns > maxNs) {
+            maxNs = ns;
+        }
+    }
+
+    /**
+    * @brief Upper bound of the bucket holding a given percentile
+    *
+    * @param p percentile, from 0 to 100
+    *
+    * @return latency in nanoseconds
+    */
+    uint64_t percentile(double p) const {
+        uint64_t target = count * p / 100;
+        uint64_t seen = 0;
+        for (int i=0;i<NRF_HISTOGRAM_BUCKETS;i++) {
+            seen += buckets[i];
+            if (seen > target) {
+                return (2ULL << i) - 1;
+            }
+        }
+        return maxNs;
+    }
+};
+
+/**
+* @brief What went over the wire, counted by NRFTransport
+*/
+struct NRFTransportStats {
+    uint64_t submissions;
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t errors;
+    NRFHistogram submitLatency;
+
+    NRFTransportStats() {
+        reset();
+    }
+
+    void reset() {
+        submissions = 0;
+        transactions = 0;
+        bytes = 0;
+        errors = 0;
+        submitLatency.reset();
+    }
+};
+
+/**
+* @brief Snapshot of everything a NRFController counts
+*/
+struct NRFStats {
+    NRFTransportStats transport;
+    uint64_t rxPackets;
+    uint64_t txPackets;
+    uint64_t txFailures;
+    uint64_t rxFifoFull;
+    uint64_t txFifoFull;
+    uint64_t maxRtEvents;
+    //OBSERVE_TX, as read when the snapshot was taken
+    uint8_t lostPackets;
+    uint8_t retransmits;
+    NRFHistogram rxLatency;
+    NRFHistogram txLatency;
+
+    NRFStats() {
+        reset();
+    }
+
+    void reset() {
+        transport.reset();
+        rxPackets = 0;
+        txPackets = 0;
+        txFailures = 0;
+        rxFifoFull = 0;
+        txFifoFull = 0;
+        maxRtEvents = 0;
+        lostPackets = 0;
+        retransmits = 0;
+        rxLatency.reset();
+        txLatency.reset();
+    }
+};
+
+#endif
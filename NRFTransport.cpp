@@ -0,0 +1,285 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NRFTransport.h"
+#include <stddef.h>
+#include <time.h>
+
+NRFTransport::NRFTransport() {
+    m_queueSubmitted = false;
+    m_queue.reserve(HW_MAX_QUEUED_TRANSACTS);
+    m_queueOffsets.reserve(HW_MAX_QUEUED_TRANSACTS);
+}
+
+NRFTransport::~NRFTransport() {
+}
+
+/**
+* @brief Hold CE high for at least the given time
+* The wait spins on the monotonic clock instead of sleeping: a sleep of a few
+* microseconds may last as long as a scheduler tick, while the module only
+* needs 10us to start a transmission.
+*
+* @param us minimum high time, in microseconds
+*
+* @return true for success, false otherwise
+*/
+bool NRFTransport::pulseCE(int us) {
+    struct timespec start;
+    struct timespec now;
+    int64_t elapsedNs;
+
+    if (!setCE()) {
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsedNs = (int64_t)(now.tv_sec - start.tv_sec) * 1000000000 + now.tv_nsec - start.tv_nsec;
+    } while (elapsedNs < (int64_t)us * 1000);
+
+    return clearCE();
+}
+
+/**
+* @brief Start watching the module IRQ pin. Transports that can't do it keep
+* this default implementation.
+*
+* @param gpioChip GPIO chip device the pin belongs to, like /dev/gpiochip0
+* @param line line offset of the IRQ pin inside the chip
+*
+* @return true for success, false otherwise
+*/
+bool NRFTransport::openIRQ(const char* gpioChip, int line) {
+    (void)gpioChip;
+    (void)line;
+    return false;
+}
+
+/**
+* @brief Change the SPI clock. Transports without a clock to change keep this
+* default implementation.
+*
+* @param hz clock frequency, in Hz
+*
+* @return true for success, false otherwise
+*/
+bool NRFTransport::setSpeed(uint32_t hz) {
+    (void)hz;
+    return false;
+}
+
+/**
+* @return SPI clock frequency in Hz, 0 if the transport has none
+*/
+uint32_t NRFTransport::speed() const {
+    return 0;
+}
+
+/**
+* @brief Send and receive bytes over SPI interface
+* The method will block until de end of transaction. tx and rx buffers must
+* be allocated prior to calling this method
+*
+* @param tx array of size n containing data to be transmitted
+* @param rx array of size n that will be filled with bytes received
+* @param n size of tx and rx buffers
+*
+* @return true for success, false otherwise
+*/
+bool NRFTransport::transact(const uint8_t* tx, uint8_t* rx, int n) {
+    NRFTransfer single;
+
+    single.tx = tx;
+    single.rx = rx;
+    single.size = n;
+    single.delayUs = 0;
+
+    return submitTransfers(&single, 1);
+}
+
+/**
+* @brief Queue a SPI transaction to be sent later by submit()
+* Each queued transaction gets its own chip select cycle, so the module sees
+* them as separate commands. Queueing after a submit() starts a new batch.
+*
+* @param tx array of size n containing data to be transmitted. It's copied, so
+* it may be reused right after this call
+* @param n size of tx buffer
+* @param delayUs how long to wait after this transaction before starting the
+* next one, for commands that need time to take effect
+*
+* @return an id to retrieve the response with response(), or -1 if the queue is full
+*/
+int NRFTransport::queueTransact(const uint8_t* tx, int n, int delayUs) {
+    NRFTransfer transfer;
+
+    startBatch();
+    if (queuedTransacts() >= HW_MAX_QUEUED_TRANSACTS || n <= 0) {
+        return -1;
+    }
+
+    //pointers are only known at submit(), m_queueTx may move until then
+    transfer.tx = NULL;
+    transfer.rx = NULL;
+    transfer.size = n;
+    transfer.delayUs = delayUs;
+    m_queueOffsets.push_back(m_queueTx.size());
+    m_queueTx.insert(m_queueTx.end(), tx, tx + n);
+    m_queue.push_back(transfer);
+
+    return queuedTransacts() - 1;
+}
+
+/**
+* @brief Queue a SPI transaction working straight on the caller's memory,
+* without copies: buffer is sent and then overwritten with the received bytes.
+*
+* @param buffer array of size n with the bytes to send. It must stay valid
+* until submit() returns, and holds the response afterwards
+* @param n size of buffer
+* @param delayUs how long to wait after this transaction before starting the
+* next one
+*
+* @return an id to retrieve the response with response(), or -1 if the queue is full
+*/
+int NRFTransport::queueInPlace(uint8_t* buffer, int n, int delayUs) {
+    NRFTransfer transfer;
+
+    startBatch();
+    if (queuedTransacts() >= HW_MAX_QUEUED_TRANSACTS || n <= 0) {
+        return -1;
+    }
+
+    transfer.tx = buffer;
+    transfer.rx = buffer;
+    transfer.size = n;
+    transfer.delayUs = delayUs;
+    m_queueOffsets.push_back(-1);
+    m_queue.push_back(transfer);
+
+    return queuedTransacts() - 1;
+}
+
+/**
+* @brief Queueing after a submit() starts a new batch
+*/
+void NRFTransport::startBatch() {
+    if (m_queueSubmitted) {
+        m_queueTx.clear();
+        m_queueOffsets.clear();
+        m_queue.clear();
+        m_queueSubmitted = false;
+    }
+}
+
+/**
+* @brief Send every queued transaction in a single submission
+* The method will block until the end of the last transaction.
+*
+* @return true for success, false otherwise
+*/
+bool NRFTransport::submit() {
+    int count = queuedTransacts();
+
+    if (m_queueSubmitted || count == 0) {
+        return true;
+    }
+    m_queueSubmitted = true;
+
+    //every byte gets overwritten by the transfer, no need to clear them
+    m_queueRx.resize(m_queueTx.size());
+    for (int i=0;i<count;i++) {
+        if (m_queueOffsets[i] >= 0) {
+            m_queue[i].tx = &m_queueTx[m_queueOffsets[i]];
+            m_queue[i].rx = &m_queueRx[m_queueOffsets[i]];
+        }
+    }
+
+    return submitTransfers(&m_queue[0], count);
+}
+
+/**
+* @brief Drop every transaction queued since the last submit(), without
+* sending them
+*/
+void NRFTransport::discardQueue() {
+    if (!m_queueSubmitted) {
+        m_queueTx.clear();
+        m_queueOffsets.clear();
+        m_queue.clear();
+    }
+}
+
+/**
+* @brief Retrieve bytes received by a queued transaction, after submit()
+*
+* @param transactId id returned by queueTransact() or queueInPlace()
+*
+* @return pointer to received bytes, same size used when queueing. Valid
+* until the next transaction is queued
+*/
+const uint8_t* NRFTransport::response(int transactId) const {
+    if (!m_queueSubmitted || transactId < 0 || transactId >= queuedTransacts()) {
+        return NULL;
+    }
+
+    return m_queue[transactId].rx;
+}
+
+/**
+* @brief How many transactions are waiting in current batch
+*
+* @return number of queued transactions
+*/
+int NRFTransport::queuedTransacts() const {
+    return m_queue.size();
+}
+
+/**
+* @brief Counters for everything sent through this transport
+*
+* @return current counters
+*/
+const NRFTransportStats& NRFTransport::stats() const {
+    return m_stats;
+}
+
+void NRFTransport::resetStats() {
+    m_stats.reset();
+}
+
+bool NRFTransport::submitTransfers(const NRFTransfer* transfers, int count) {
+    bool ok;
+    NRF_STATS(uint64_t start = nrfStatsNowNs());
+
+    ok = transfer(transfers, count);
+
+    NRF_STATS(m_stats.submitLatency.record(nrfStatsNowNs() - start));
+    NRF_STATS(m_stats.submissions++);
+    NRF_STATS(m_stats.transactions += count);
+    for (int i=0;i<count;i++) {
+        NRF_STATS(m_stats.bytes += transfers[i].size);
+    }
+    if (!ok) {
+        NRF_STATS(m_stats.errors++);
+    }
+
+    return ok;
+}
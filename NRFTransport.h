@@ -0,0 +1,91 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NRF_TRANSPORT_H
+#define NRF_TRANSPORT_H
+
+#include "NRFStats.h"
+#include <vector>
+#include <stdint.h>
+
+//how many transfers fit in a single SPI_IOC_MESSAGE ioctl
+#define HW_MAX_QUEUED_TRANSACTS 511
+
+//SPI clock, the module accepts up to 10MHz
+#define NRF_SPI_DEFAULT_SPEED 1000000
+#define NRF_SPI_MAX_SPEED 10000000
+
+/**
+* @brief One command/response exchange, with its own chip select cycle
+*/
+struct NRFTransfer {
+    const uint8_t* tx;
+    uint8_t* rx;
+    int size;
+    int delayUs; //idle time after the transfer, before the next one starts
+};
+
+/**
+* @brief Interface to whatever carries SPI commands and drives CE/IRQ pins of a
+* NRF24L01+ module. HWAbstraction talks to real hardware, NRFSimulator to a
+* software model of the chip.
+*/
+class NRFTransport {
+    public:
+    NRFTransport();
+    virtual ~NRFTransport();
+
+    virtual int openDevice() = 0;
+    virtual void closeDevice() = 0;
+    virtual bool setCE() = 0;
+    virtual bool clearCE() = 0;
+    virtual bool pulseCE(int us);
+    virtual bool openIRQ(const char* gpioChip, int line);
+    virtual bool setSpeed(uint32_t hz);
+    virtual uint32_t speed() const;
+    virtual int irqFd() const = 0;
+    virtual bool irqAsserted() = 0;
+    virtual int waitIRQ(int timeoutMs) = 0;
+
+    bool transact(const uint8_t* tx, uint8_t* rx, int n);
+    int queueTransact(const uint8_t* tx, int n, int delayUs = 0);
+    int queueInPlace(uint8_t* buffer, int n, int delayUs = 0);
+    bool submit();
+    void discardQueue();
+    const uint8_t* response(int transactId) const;
+    int queuedTransacts() const;
+    const NRFTransportStats& stats() const;
+    void resetStats();
+
+    protected:
+    virtual bool transfer(const NRFTransfer* transfers, int count) = 0;
+
+    private:
+    bool submitTransfers(const NRFTransfer* transfers, int count);
+    void startBatch();
+
+    NRFTransportStats m_stats;
+    std::vector<uint8_t> m_queueTx;
+    std::vector<uint8_t> m_queueRx;
+    //offset of each transaction in m_queueTx, or -1 for in place ones
+    std::vector<int> m_queueOffsets;
+    std::vector<NRFTransfer> m_queue;
+    bool m_queueSubmitted;
+};
+
+#endif
@@ -0,0 +1,346 @@
+/*                                                                                 
+    This file is part of libNRF24L01p.                                 
+    Copyright 2013  Vitor Boschi da Silva <vitorboschi@gmail.com>                            
+                                                                                   
+    This library is free software; you can redistribute it and/or                  
+    modify it under the terms of the GNU Lesser General Public                     
+    License as published by the Free Software Foundation; either                   
+    version 2.1 of the License, or (at your option) any later version.             
+                                                                                   
+    This library is distributed in the hope that it will be useful,                
+    but WITHOUT ANY WARRANTY; without even the implied warranty of                 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU              
+    Lesser General Public License for more details.                                
+                                                                                   
+    You should have received a copy of the GNU Lesser General Public               
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Benchmarks for controller hot paths, running against NRFSimulator so they
+    work on any Linux box. Each result is printed as a JSON object on its own
+    line, to make tracking regressions easy.
+*/
+
+#include "NRFController.h"
+#include "NRFSimulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+
+struct BenchOptions {
+    int iterations;
+    int packets;
+    uint32_t spiTransactNs;
+    uint32_t spiByteNs;
+    uint32_t spiSpeed;
+    double airScale;
+    const char* filter;
+};
+
+struct BenchPair {
+    NRFAirLink air;
+    NRFSimulator txRadio;
+    NRFSimulator rxRadio;
+    NRFController tx;
+    NRFController rx;
+
+    BenchPair(const BenchOptions& opts) : tx(&txRadio), rx(&rxRadio) {
+        NRFSimulator* radios[] = {&txRadio, &rxRadio};
+        NRFController* controllers[] = {&tx, &rx};
+
+        for (int i=0;i<2;i++) {
+            air.attach(radios[i]);
+            radios[i]->openDevice();
+            radios[i]->setSpiLatency(opts.spiTransactNs, opts.spiByteNs);
+            if (opts.spiSpeed) {
+                controllers[i]->setSpiSpeed(opts.spiSpeed);
+            }
+            radios[i]->setAirTimeScale(opts.airScale);
+            controllers[i]->syncRegisters();
+            controllers[i]->setChannel(76);
+            controllers[i]->setDataRate(NRFController::NRF2Mbps);
+            controllers[i]->setCRC(2);
+            controllers[i]->setRetries(15);
+            controllers[i]->setPacketSize(NRF_MAX_PAYLOAD_SIZE);
+            controllers[i]->setPowerUp(true);
+        }
+        tx.setMode(NRFController::NRFTxMode);
+        rx.setMode(NRFController::NRFRxMode);
+        txRadio.resetCounters();
+        rxRadio.resetCounters();
+    }
+};
+
+static uint64_t nowNs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void report(const char* name, uint64_t ops, uint64_t ns, const NRFSimulator& radio) {
+    double perOp = ops ? 1.0 / ops : 0;
+
+    printf("{\"benchmark\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f,"
+            "\"spi_transactions_per_op\":%.3f,\"submissions_per_op\":%.3f,\"spi_bytes_per_op\":%.2f}\n",
+            name, (unsigned long long)ops, ns * perOp, ns ? ops * 1e9 / ns : 0,
+            radio.transactions() * perOp, radio.submissions() * perOp, radio.spiBytes() * perOp);
+    fflush(stdout);
+}
+
+static bool selected(const BenchOptions& opts, const char* name) {
+    return !opts.filter || strstr(name, opts.filter);
+}
+
+static void benchRegRead(const BenchOptions& opts) {
+    BenchPair pair(opts);
+    uint64_t start = nowNs();
+
+    for (int i=0;i<opts.iterations;i++) {
+        pair.tx.invalidateRegister(NRF_REG_SETUP_AW);
+        pair.tx.addressWidth();
+    }
+    report("reg_read", opts.iterations, nowNs() - start, pair.txRadio);
+}
+
+static void benchRegReadCached(const BenchOptions& opts) {
+    BenchPair pair(opts);
+    uint64_t start = nowNs();
+
+    for (int i=0;i<opts.iterations;i++) {
+        pair.tx.addressWidth();
+    }
+    report("reg_read_cached", opts.iterations, nowNs() - start, pair.txRadio);
+}
+
+static void benchRegWrite(const BenchOptions& opts) {
+    BenchPair pair(opts);
+    uint64_t start = nowNs();
+
+    for (int i=0;i<opts.iterations;i++) {
+        pair.tx.setChannel(i & 1 ? 10 : 20);
+    }
+    report("reg_write", opts.iterations, nowNs() - start, pair.txRadio);
+}
+
+static void benchStatusPoll(const BenchOptions& opts) {
+    BenchPair pair(opts);
+    uint64_t start = nowNs();
+
+    for (int i=0;i<opts.iterations;i++) {
+        pair.rx.dataAvailable();
+    }
+    report("status_poll", opts.iterations, nowNs() - start, pair.rxRadio);
+}
+
+static void benchSyncRegisters(const BenchOptions& opts) {
+    BenchPair pair(opts);
+    uint64_t start = nowNs();
+
+    for (int i=0;i<opts.iterations;i++) {
+        pair.tx.syncRegisters();
+    }
+    report("sync_registers", opts.iterations, nowNs() - start, pair.txRadio);
+}
+
+static void benchReconfigure(const BenchOptions& opts) {
+    BenchPair pair(opts);
+    uint64_t start = nowNs();
+
+    //what a channel hop with a link parameter change costs
+    for (int i=0;i<opts.iterations;i++) {
+        pair.tx.setChannel(2 + (i * 7) % 120);
+        pair.tx.setDataRate(i & 1 ? NRFController::NRF1Mbps : NRFController::NRF2Mbps);
+        pair.tx.setRetries(i & 1 ? 5 : 15);
+        pair.tx.setCRC(2);
+    }
+    report("reconfigure", opts.iterations, nowNs() - start, pair.txRadio);
+}
+
+/**
+* @brief Feed packages from a sender thread and measure the receiving side
+*/
+static void benchReceive(const BenchOptions& opts, bool burst) {
+    BenchPair pair(opts);
+    int size = opts.packets * NRF_MAX_PAYLOAD_SIZE;
+    char* data = new char[size];
+    std::atomic<bool> sending(true);
+    uint64_t received = 0;
+    uint64_t start;
+
+    memset(data, 0x55, size);
+    start = nowNs();
+    std::thread sender([&]() {
+        pair.tx.writeData(size, data);
+        sending = false;
+    });
+
+    while (sending || pair.rx.dataAvailable()) {
+        int count;
+        if (burst) {
+            NRFPacket packets[NRF_RX_FIFO_DEPTH];
+            count = pair.rx.readBurst(packets, NRF_RX_FIFO_DEPTH);
+        }
+        else {
+            uint8_t buffer[NRF_MAX_PAYLOAD_SIZE];
+            count = pair.rx.readData(buffer) > 0;
+        }
+        received += count;
+
+        //sleep on the IRQ instead of counting idle polls
+        if (count == 0) {
+            pair.rx.waitForEvent(1);
+        }
+    }
+    sender.join();
+
+    report(burst ? "rx_read_burst" : "rx_read_data", received, nowNs() - start, pair.rxRadio);
+    delete[] data;
+}
+
+enum BenchTx {
+    BenchSendPkg,
+    BenchWriteData,
+    BenchBroadcastData
+};
+
+/**
+* @brief Drain packages on a receiver thread and measure the sending side
+*/
+static void benchTransmit(const BenchOptions& opts, BenchTx method) {
+    static const char* names[] = {"tx_send_pkg", "tx_write_data", "tx_broadcast_data"};
+    BenchPair pair(opts);
+    int size = opts.packets * NRF_MAX_PAYLOAD_SIZE;
+    char* data = new char[size];
+    std::atomic<bool> receiving(true);
+    uint64_t sent = 0;
+    uint64_t start;
+
+    memset(data, 0xAA, size);
+    std::thread receiver([&]() {
+        NRFPacket packets[NRF_RX_FIFO_DEPTH];
+        while (receiving) {
+            if (pair.rx.readBurst(packets, NRF_RX_FIFO_DEPTH) == 0) {
+                pair.rx.waitForEvent(1);
+            }
+        }
+    });
+
+    start = nowNs();
+    switch (method) {
+        case BenchSendPkg:
+            for (int i=0;i<opts.packets;i++) {
+                sent += pair.tx.sendPkg(data + i * NRF_MAX_PAYLOAD_SIZE);
+            }
+            break;
+        case BenchWriteData:
+            sent = pair.tx.writeData(size, data) / NRF_MAX_PAYLOAD_SIZE;
+            break;
+        case BenchBroadcastData:
+            sent = pair.tx.broadcastData(size, data) / NRF_MAX_PAYLOAD_SIZE;
+            break;
+    }
+    uint64_t elapsed = nowNs() - start;
+
+    receiving = false;
+    receiver.join();
+
+    report(names[method], sent, elapsed, pair.txRadio);
+    delete[] data;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n N      iterations for register benchmarks (default 10000)\n"
+            "  -p N      packages for link benchmarks (default 1000)\n"
+            "  -t NS     simulated cost of each SPI command, in ns (default 0)\n"
+            "  -b NS     simulated cost of each SPI byte, in ns (default 0, 8000 = 1MHz)\n"
+            "  -s HZ     SPI clock, sets the cost of each byte instead of -b\n"
+            "  -a SCALE  air time scale, 1.0 follows the datasheet (default 1.0)\n"
+            "  -f NAME   only run benchmarks whose name contains NAME\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    int opt;
+
+    opts.iterations = 10000;
+    opts.packets = 1000;
+    opts.spiTransactNs = 0;
+    opts.spiByteNs = 0;
+    opts.spiSpeed = 0;
+    opts.airScale = 1.0;
+    opts.filter = NULL;
+
+    while ((opt = getopt(argc, argv, "n:p:t:b:s:a:f:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                opts.iterations = atoi(optarg);
+                break;
+            case 'p':
+                opts.packets = atoi(optarg);
+                break;
+            case 't':
+                opts.spiTransactNs = atoi(optarg);
+                break;
+            case 'b':
+                opts.spiByteNs = atoi(optarg);
+                break;
+            case 's':
+                opts.spiSpeed = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                opts.airScale = atof(optarg);
+                break;
+            case 'f':
+                opts.filter = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (selected(opts, "reg_read")) {
+        benchRegRead(opts);
+    }
+    if (selected(opts, "reg_read_cached")) {
+        benchRegReadCached(opts);
+    }
+    if (selected(opts, "reg_write")) {
+        benchRegWrite(opts);
+    }
+    if (selected(opts, "status_poll")) {
+        benchStatusPoll(opts);
+    }
+    if (selected(opts, "sync_registers")) {
+        benchSyncRegisters(opts);
+    }
+    if (selected(opts, "reconfigure")) {
+        benchReconfigure(opts);
+    }
+    if (selected(opts, "rx_read_data")) {
+        benchReceive(opts, false);
+    }
+    if (selected(opts, "rx_read_burst")) {
+        benchReceive(opts, true);
+    }
+    if (selected(opts, "tx_send_pkg")) {
+        benchTransmit(opts, BenchSendPkg);
+    }
+    if (selected(opts, "tx_write_data")) {
+        benchTransmit(opts, BenchWriteData);
+    }
+    if (selected(opts, "tx_broadcast_data")) {
+        benchTransmit(opts, BenchBroadcastData);
+    }
+
+    return 0;
+}